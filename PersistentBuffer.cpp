@@ -1,371 +1,3504 @@
 #include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 #include <sstream>
+#include <fstream>
 #include <algorithm>
 #include <iostream>
+#include <cmath>
+#include <thread>
+#include <condition_variable>
 
-#include "PersistentBuffer.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#endif
 
-time_t PersistentBuffer::m_cleanup_timeout{0}; // zero means do not garbage collect; >zero is in seconds
-time_t PersistentBuffer::m_last_cleanup_check{0};
-std::bitset<PersistentBuffer::Policy::TotalPolicies> PersistentBuffer::m_policies;
-std::mutex PersistentBuffer::m_buffers_lock;
-PersistentBuffer::BufferMap PersistentBuffer::m_buffers;
-int PersistentBuffer::m_buffers_in_use{0};
-PersistentBuffer::SizeList PersistentBuffer::m_size_list;
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <immintrin.h>
+#define PERSISTENTBUFFER_STREAMING_STORES
+#endif
 
-static bool m_initialized{false};
+#include "PersistentBuffer.h"
 
-#if PERSISTENTBUFFER_TRACKING >= 2
-using tracking_data_t = std::pair<std::string, int>;
-using tracking_map_t = std::map<const void*, tracking_data_t>;
-static tracking_map_t _tracking_map;
+#if !defined(_WIN32) && (defined(__GLIBC__) || defined(__APPLE__))
+#include <execinfo.h>
+#define PERSISTENTBUFFER_EXECINFO
 #endif
 
-//----------------------------------------------------------------------------
-// PersistentBuffer::Buffer methods
+// USDT probes (provider "persistentbuffer"), where SystemTap's <sys/sdt.h>
+// is available.  each is a single nop until something attaches to it
+#if !defined(PERSISTENTBUFFER_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PERSISTENTBUFFER_USDT
+#endif
+#endif
 
-uint8_t const * const PersistentBuffer::Buffer::ro() const
-{
-	if (m_in_use)
-		return m_buffer.get();
+#ifdef PERSISTENTBUFFER_USDT
+#define PERSISTENTBUFFER_PROBE1(name, a) DTRACE_PROBE1(persistentbuffer, name, a)
+#define PERSISTENTBUFFER_PROBE2(name, a, b) DTRACE_PROBE2(persistentbuffer, name, a, b)
+#define PERSISTENTBUFFER_PROBE4(name, a, b, c, d) DTRACE_PROBE4(persistentbuffer, name, a, b, c, d)
+#else
+#define PERSISTENTBUFFER_PROBE1(name, a) ((void)0)
+#define PERSISTENTBUFFER_PROBE2(name, a, b) ((void)0)
+#define PERSISTENTBUFFER_PROBE4(name, a, b, c, d) ((void)0)
+#endif
 
-	assert(false);
-	return nullptr;
-}
+// size classes never go below this, and are kept aligned to it
+static const uint32_t _min_bin_size{16};
+// requests above the largest class fall through to exact-size allocation
+static const uint32_t _max_bin_size{1u << 31};
 
-uint8_t * const PersistentBuffer::Buffer::rw() const
-{
-	if (m_in_use)
-		return m_buffer.get();
+// 'Buffer::m_slot' of a buffer that is not in the registry
+static const uint32_t _no_slot{0xFFFFFFFF};
 
-	assert(false);
-	return nullptr;
-}
+// storage carved from a slab is aligned to a cache line
+static const size_t _slab_alignment{64};
+// huge-page slabs are sized in multiples of this
+static const size_t _huge_page_size{2 * 1024 * 1024};
+// pre-faulting writes to storage at this stride
+static const size_t _page_size{4096};
 
-//----------------------------------------------------------------------------
-// PersistentBuffer methods
+// 'AdaptiveSizing': a histogram step is popular once it holds this fraction
+// (one in so many) of recent requests
+static const uint64_t _popular_share{16};
+
+#ifndef _WIN32
+// from <linux/mempolicy.h>; mbind() is called directly, rather than taking
+// a dependency on libnuma
+static const int _mpol_preferred{1};
+#endif
 
-void PersistentBuffer::initialize()
+// the steady clock, in nanoseconds, for tracing and lock profiling
+static inline uint64_t steady_ns()
 {
-	m_policies.set(Policy::ZeroBuffer);
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
 
-	m_initialized = true;
+// raises a single-writer counter (see bump()) to 'value', if that is higher
+static inline void raise_to(std::atomic<uint64_t>& counter, uint64_t value)
+{
+	if (value > counter.load(std::memory_order_relaxed))
+		counter.store(value, std::memory_order_relaxed);
 }
 
-void PersistentBuffer::set_cleanup_timeout(time_t seconds)
+// adds to a counter that has a single writer at any one time (the lock
+// holder, or the thread that owns it).  readers only need a value that is not
+// torn, so this avoids a locked read-modify-write
+static inline void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1)
 {
-	m_cleanup_timeout = seconds;
-	m_last_cleanup_check = time(nullptr);
-	set_policy(Policy::DropOld);
+	counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
 }
 
-void PersistentBuffer::set_policy(Policy policy)
+static inline void bump(std::atomic<int64_t>& counter, int64_t amount = 1)
 {
-	m_policies.set(policy);
+	counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
 }
 
-void PersistentBuffer::set_policy(std::initializer_list<Policy> policies)
+// the size histogram entry for a request of 'size' bytes: the smallest i
+// for which 'size' <= 2^i
+static inline int histogram_bucket(uint32_t size)
 {
-	for (Policy p : policies)
-		m_policies.set(p);
+	if (size <= 1)
+		return 0;
+#ifdef _MSC_VER
+	unsigned long bit;
+	_BitScanReverse(&bit, size - 1);
+	return static_cast<int>(bit) + 1;
+#else
+	return 32 - __builtin_clz(size - 1);
+#endif
 }
 
-void PersistentBuffer::clear_policy(Policy policy)
+// the 'AdaptiveSizing' histogram step for a request of 'size' bytes: every
+// power of two above 4 is split into four equal steps
+static inline int demand_bucket(uint32_t size)
 {
-	m_policies.reset(policy);
+	int octave{histogram_bucket(size)};
+	if (octave < 3)
+		return octave * 4;
+	uint64_t base{uint64_t{1} << (octave - 1)};
+	return octave * 4 + static_cast<int>((size - 1 - base) * 4 / base);
 }
 
-void PersistentBuffer::reset()
+// the largest request that falls in histogram step 'bucket'
+static inline uint64_t demand_bucket_top(int bucket)
 {
-	m_policies.reset();
-	m_policies.set(Policy::ZeroBuffer);
-	for (BufferMapKey key : m_buffers)
-		key.first->reset();
-	m_buffers.clear();
+	int octave{bucket / 4};
+	if (octave < 3)
+		return uint64_t{1} << octave;
+	uint64_t base{uint64_t{1} << (octave - 1)};
+	return base + (bucket % 4 + 1) * base / 4;
 }
 
-PersistentBuffer::BufferPtr PersistentBuffer::single_buffer(uint32_t min_size
-#if PERSISTENTBUFFER_TRACKING >= 2
-	, const tracking_data_t& caller
-#endif
-)
+// blocks at least this large are zeroed with non-temporal stores
+static const size_t _streaming_threshold{256 * 1024};
+
+// zeroes 'bytes' at 'data'.  large blocks would only evict the working set
+// from the cache on their way to memory, so they are written around it
+static void zero_storage(uint8_t* data, size_t bytes)
 {
-	std::unique_lock<std::mutex> buffers_lock(m_buffers_lock);
-	auto buffer{single_buffer_unprotected(min_size)};
-#if PERSISTENTBUFFER_TRACKING >= 2
-	if (!caller.first.empty())
+#ifdef PERSISTENTBUFFER_STREAMING_STORES
+	if (bytes >= _streaming_threshold)
 	{
-		auto key{static_cast<const void *>(buffer->ro())};
-		_tracking_map[key] = caller;
-		std::cerr << "+++ buffer " << key << " allocated by " << caller.first << ":"
-			<< caller.second << std::endl;
-		std::cerr.flush();
+		// streaming stores must be aligned; the ragged ends are left to memset()
+		auto head{(64 - (reinterpret_cast<uintptr_t>(data) & 63)) & 63};
+		memset(data, 0, head);
+		data += head;
+		bytes -= head;
+
+#ifdef __AVX2__
+		const __m256i zero{_mm256_setzero_si256()};
+		for (; bytes >= 128; data += 128, bytes -= 128)
+		{
+			_mm256_stream_si256(reinterpret_cast<__m256i*>(data), zero);
+			_mm256_stream_si256(reinterpret_cast<__m256i*>(data + 32), zero);
+			_mm256_stream_si256(reinterpret_cast<__m256i*>(data + 64), zero);
+			_mm256_stream_si256(reinterpret_cast<__m256i*>(data + 96), zero);
+		}
+#else
+		const __m128i zero{_mm_setzero_si128()};
+		for (; bytes >= 64; data += 64, bytes -= 64)
+		{
+			_mm_stream_si128(reinterpret_cast<__m128i*>(data), zero);
+			_mm_stream_si128(reinterpret_cast<__m128i*>(data + 16), zero);
+			_mm_stream_si128(reinterpret_cast<__m128i*>(data + 32), zero);
+			_mm_stream_si128(reinterpret_cast<__m128i*>(data + 48), zero);
+		}
+#endif
+		// make the streamed stores visible before the buffer changes hands
+		_mm_sfence();
 	}
 #endif
-#if PERSISTENTBUFFER_TRACKING == 1 || PERSISTENTBUFFER_TRACKING == 3
-	std::cerr << "<< " << m_size_list.size() << " buffers allocated, "
-		<< m_buffers_in_use << " buffers in use, "
-		<< (m_size_list.size() - m_buffers_in_use) << " buffers free."
-		<< std::endl;
-	std::cerr.flush();
+	memset(data, 0, bytes);
+}
+
+// gives the whole pages within 'bytes' at 'data' back to the OS, keeping the
+// address range.  whatever the pages held may be lost, and they are faulted
+// back in (zero-filled, or as they were) when next touched.  returns the
+// number of bytes released
+static size_t release_pages(uint8_t* data, size_t bytes)
+{
+#ifdef _WIN32
+	static const size_t page_size{_page_size};
+#else
+	static const size_t page_size{static_cast<size_t>(sysconf(_SC_PAGESIZE))};
+#endif
+	auto first{(reinterpret_cast<uintptr_t>(data) + page_size - 1) & ~(page_size - 1)};
+	auto last{(reinterpret_cast<uintptr_t>(data) + bytes) & ~(page_size - 1)};
+	if (last <= first)
+		return 0;
+
+	auto base{reinterpret_cast<void*>(first)};
+	auto length{static_cast<size_t>(last - first)};
+#ifdef _WIN32
+	if (!VirtualAlloc(base, length, MEM_RESET, PAGE_READWRITE))
+		return 0;
+#else
+	// MADV_FREE lets the kernel take the pages lazily, and is cheaper to
+	// fault back from if it has not
+#ifdef MADV_FREE
+	if (madvise(base, length, MADV_FREE) == 0)
+		return length;
 #endif
-  return buffer;
+	if (madvise(base, length, MADV_DONTNEED) != 0)
+		return 0;
+#endif
+	return length;
 }
 
-// get a buffer with the required 'size' holding the provided content
-PersistentBuffer::BufferPtr PersistentBuffer::single_buffer_from(const std::string& data
-#if PERSISTENTBUFFER_TRACKING >= 2
-	, const tracking_data_t& caller
+// sources of 'BufferPool::m_id' and 'BufferPool::m_layout_id'
+static std::atomic<uint64_t> _next_pool_id{1};
+static std::atomic<uint32_t> _next_layout_id{1};
+
+// guards the link between each thread cache and its pool, so that a thread
+// exiting (which spills its caches) and a pool being destroyed (which
+// detaches them) never overlap.  taken before any pool lock
+static std::mutex _caches_lock;
+
+// one in this many tracked acquisitions captures a backtrace (zero for none)
+static std::atomic<uint32_t> _tracking_sample_rate{0};
+static std::atomic<uint32_t> _tracking_sample_count{0};
+
+// fills 'frames' with the caller's stack, returning the number captured
+static int capture_backtrace(void** frames, int count)
+{
+#if defined(_WIN32)
+	return CaptureStackBackTrace(0, static_cast<DWORD>(count), frames, nullptr);
+#elif defined(PERSISTENTBUFFER_EXECINFO)
+	return backtrace(frames, count);
+#else
+	(void)frames;
+	(void)count;
+	return 0;
 #endif
-)
+}
+
+//----------------------------------------------------------------------------
+// BufferPool::RemoteQueue
+
+// a stack of free buffers linked through 'Buffer::m_next_remote'.  any thread
+// may push; the owner only ever takes the whole stack in one exchange, so
+// there is no ABA hazard
+struct BufferPool::RemoteQueue
 {
-	auto buffer{single_buffer_from(reinterpret_cast<const uint8_t*>(data.c_str()), static_cast<uint32_t>(data.length() + 1))};
-#if PERSISTENTBUFFER_TRACKING >= 2
-	if (!caller.first.empty())
+	// the head of a queue that no cache owns.  it is never dereferenced, and
+	// a push that finds it fails
+	static Buffer* closed() { return reinterpret_cast<Buffer*>(alignof(Buffer)); }
+
+	std::atomic<Buffer*> m_head{nullptr};
+	// roughly how many buffers are waiting; bounds the queue
+	std::atomic<size_t> m_count{0};
+};
+
+//----------------------------------------------------------------------------
+// BufferPool::PoolMutex
+
+void BufferPool::PoolMutex::lock()
+{
+	m_mutex.lock();
+	if (m_pool.m_policies[Policy::LockProfiling])
+		m_held_since = steady_ns();
+}
+
+bool BufferPool::PoolMutex::try_lock()
+{
+	if (!m_mutex.try_lock())
+		return false;
+	if (m_pool.m_policies[Policy::LockProfiling])
+		m_held_since = steady_ns();
+	return true;
+}
+
+void BufferPool::PoolMutex::unlock()
+{
+	// accounted for while still held, as the counters are written under it
+	if (m_held_since)
 	{
-		auto key{static_cast<const void*>(buffer->ro())};
-		_tracking_map[key] = caller;
-		std::cerr << "+++ buffer " << key << " allocated by " << caller.first << ":" << caller.second << std::endl;
-		std::cerr.flush();
+		auto held{steady_ns() - m_held_since};
+		m_held_since = 0;
+		m_pool.lock_held(held);
 	}
-#endif
-#if PERSISTENTBUFFER_TRACKING == 1 || PERSISTENTBUFFER_TRACKING == 3
-	std::cerr << "<< " << m_size_list.size() << " buffers allocated, " << m_buffers_in_use << " buffers in use, "
-			<< (m_size_list.size() - m_buffers_in_use) << " buffers free." << std::endl;
-	std::cerr.flush();
-#endif
-	return buffer;
+	m_mutex.unlock();
 }
 
-PersistentBuffer::BufferPtr PersistentBuffer::single_buffer_from(const char* data, size_t size
-#if PERSISTENTBUFFER_TRACKING >= 2
-	, const tracking_data_t& caller
-#endif
-)
+//----------------------------------------------------------------------------
+// BufferPool::LocalCache
+
+struct BufferPool::LocalCache
 {
-	auto buffer{single_buffer_from(reinterpret_cast<const uint8_t*>(data), static_cast<uint32_t>(size))};
-#if PERSISTENTBUFFER_TRACKING >= 2
-	if (!caller.first.empty())
+	explicit LocalCache(BufferPool& pool) : m_pool(&pool), m_pool_id(pool.m_id)
+	{
+		m_generation = pool.m_generation;
+
+		auto buffers_lock{pool.lock_buffers()};
+		pool.m_thread_caches.push_back(this);
+		m_remote = pool.claim_remote_queue();
+	}
+
+	~LocalCache()
 	{
-		auto key{static_cast<const void*>(buffer->ro())};
-		_tracking_map[key] = caller;
-		std::cerr << "+++ buffer " << key << " allocated by " << caller.first << ":" << caller.second << std::endl;
-		std::cerr.flush();
+		// caches are only destroyed by their own thread.  a release later in
+		// its exit is counted in the pool instead
+		if (last_thread_cache() == this)
+			last_thread_cache() = nullptr;
+
+		std::lock_guard<std::mutex> caches_lock(_caches_lock);
+		auto pool{m_pool.load(std::memory_order_relaxed)};
+		if (!pool)
+			return; // the pool has gone, and its buffers with it
+
+		auto buffers_lock{pool->lock_buffers()};
+		// the queue is closed in the exchange that empties it, so a release
+		// either lands before it and is spilled with the rest, or finds it
+		// closed and stays on the releasing thread
+		pool->remote_drain(*this, true);
+		if (m_generation == pool->m_generation)
+			pool->thread_cache_spill(*this, m_buffers.size());
+		pool->m_retired_stats.local_hits += m_local_hits.load(std::memory_order_relaxed);
+		pool->m_retired_stats.remote_releases += m_remote_releases.load(std::memory_order_relaxed);
+		pool->m_retired_stats.remote_drains += m_remote_drains.load(std::memory_order_relaxed);
+
+		// the usage counts live on in the pool's own
+		pool->m_buffers_in_use.fetch_add(m_buffers_in_use.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		pool->m_requested_bytes.fetch_add(m_requested_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		pool->m_in_use_bytes.fetch_add(m_in_use_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		for (int i = 0; i < histogram_buckets; ++i)
+			pool->m_size_histogram[i].fetch_add(m_size_histogram[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		for (int i = 0; i < demand_buckets; ++i)
+			pool->m_demand[i].fetch_add(m_demand[i].load(std::memory_order_relaxed) - m_demand_folded[i], std::memory_order_relaxed);
+
+		auto& caches{pool->m_thread_caches};
+		caches.erase(std::find(caches.begin(), caches.end(), this));
 	}
+
+	// the pool this cache draws from; cleared if the pool is destroyed first
+	std::atomic<BufferPool*> m_pool;
+	const uint64_t m_pool_id;
+	// free buffers owned by this thread, oldest first
+	std::vector<BufferPtr> m_buffers;
+	// pool generation these buffers were drawn from
+	uint32_t m_generation{0};
+	std::thread::id m_thread{std::this_thread::get_id()};
+	// where other threads return the buffers this thread acquired
+	RemoteQueue* m_remote{nullptr};
+	// only ever written by the owning thread; read by cache_statistics()
+	std::atomic<uint64_t> m_local_hits{0};
+	std::atomic<uint64_t> m_local_releases{0};
+	std::atomic<uint64_t> m_remote_releases{0};
+	std::atomic<uint64_t> m_remote_drains{0};
+	// usage counts (see count_in_use()), also written by the owning thread
+	// only.  a buffer may be released on another thread than the one that
+	// acquired it, so only their sum over all threads is meaningful
+	std::atomic<int64_t> m_buffers_in_use{0};
+	std::atomic<uint64_t> m_requested_bytes{0};
+	std::atomic<uint64_t> m_in_use_bytes{0};
+	std::array<std::atomic<uint64_t>, histogram_buckets> m_size_histogram{};
+	std::array<std::atomic<uint64_t>, demand_buckets> m_demand{};
+	// how much of 'm_demand' is already in the pool's (see fold_demand());
+	// guarded by the pool lock
+	std::array<uint64_t, demand_buckets> m_demand_folded{};
+};
+
+// state of the background reclamation thread (see start_reclaimer())
+struct BufferPool::ReclaimerState
+{
+	std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::thread m_thread;
+	bool m_stop{false};
+	bool m_triggered{false};
+	std::chrono::milliseconds m_interval{1000};
+	size_t m_batch_size{64};
+	std::chrono::seconds m_resolution{0};
+	// the coarse clock; zero whenever the thread is not keeping it
+	std::atomic<time_t> m_coarse_now{0};
+};
+
+//----------------------------------------------------------------------------
+// BufferPool::Slab
+
+// a large region mapped straight from the operating system.  storage is
+// carved from it with a bump pointer and never handed back individually;
+// pooled buffers are recycled rather than freed, so the whole region is
+// unmapped at once when the last buffer referencing it is dropped.
+struct BufferPool::Slab
+{
+	// a 'node' other than -1 asks for the slab's pages to be placed there
+	Slab(size_t size, bool huge_pages, int32_t node) : m_huge_pages(huge_pages)
+	{
+		if (huge_pages)
+			size = (size + _huge_page_size - 1) & ~(_huge_page_size - 1);
+		m_size = size;
+
+#ifdef _WIN32
+		if (node >= 0)
+			m_base = static_cast<uint8_t*>(VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, static_cast<DWORD>(node)));
+		else
+			m_base = static_cast<uint8_t*>(VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+		void* base{MAP_FAILED};
+#ifdef MAP_HUGETLB
+		if (huge_pages)
+			base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
 #endif
-#if PERSISTENTBUFFER_TRACKING == 1 || PERSISTENTBUFFER_TRACKING == 3
-	std::cerr << "<< " << m_size_list.size() << " buffers allocated, " << m_buffers_in_use << " buffers in use, "
-			  << (m_size_list.size() - m_buffers_in_use) << " buffers free." << std::endl;
-	std::cerr.flush();
+		if (base == MAP_FAILED)
+		{
+			base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+			// no reserved huge pages; ask for transparent ones instead
+			if (base != MAP_FAILED && huge_pages)
+				madvise(base, size, MADV_HUGEPAGE);
 #endif
-	return buffer;
-}
+		}
+		m_base = (base == MAP_FAILED) ? nullptr : static_cast<uint8_t*>(base);
+#ifdef SYS_mbind
+		// nothing has touched the pages yet, so they can still be placed.  this
+		// is only a preference; if it fails, pages follow first touch instead
+		if (m_base && node >= 0)
+		{
+			unsigned long mask{1ul << node};
+			syscall(SYS_mbind, m_base, size, _mpol_preferred, &mask, sizeof(mask) * 8, 0);
+		}
+#endif
+#endif
+	}
 
-PersistentBuffer::BufferPtr PersistentBuffer::single_buffer_from(const uint8_t* data, uint32_t size
-#if PERSISTENTBUFFER_TRACKING >= 2
-	, const tracking_data_t& caller
+	~Slab()
+	{
+		if (!m_base)
+			return;
+#ifdef _WIN32
+		VirtualFree(m_base, 0, MEM_RELEASE);
+#else
+		munmap(m_base, m_size);
 #endif
-)
-{
-	std::unique_lock<std::mutex> buffers_lock(m_buffers_lock);
-	auto buffer{single_buffer_unprotected(size)};
-	auto p{buffer->rw()};
-	memcpy(p, data, size);
-#if PERSISTENTBUFFER_TRACKING >= 2
-	if (!caller.first.empty())
+	}
+
+	// returns nullptr if the slab cannot hold 'bytes' more
+	uint8_t* carve(size_t bytes, size_t alignment)
 	{
-		auto key{static_cast<const void*>(p)};
-		_tracking_map[key] = caller;
-		std::cerr << "+++ buffer " << key << " allocated by " << caller.first << ":" << caller.second << std::endl;
-		std::cerr.flush();
+		alignment = std::max(alignment, _slab_alignment);
+		auto offset{(m_used + alignment - 1) & ~(alignment - 1)};
+		if (!m_base || offset + bytes > m_size)
+			return nullptr;
+		m_used = offset + bytes;
+		return m_base + offset;
 	}
+
+	// resizes a slab that holds a single buffer, moving it if it must.  the
+	// contents are kept, and any pages added are zero-filled.  returns false if
+	// the mapping could not be changed
+	bool remap(size_t size)
+	{
+#ifdef MREMAP_MAYMOVE
+		if (m_huge_pages)
+			size = (size + _huge_page_size - 1) & ~(_huge_page_size - 1);
+		if (size <= m_size)
+			return m_base != nullptr;
+
+		void* base{mremap(m_base, m_size, size, MREMAP_MAYMOVE)};
+		if (base == MAP_FAILED)
+			return false;
+		m_base = static_cast<uint8_t*>(base);
+		m_size = m_used = size;
+		return true;
+#else
+		(void)size;
+		return false;
 #endif
-#if PERSISTENTBUFFER_TRACKING == 1 || PERSISTENTBUFFER_TRACKING == 3
-	std::cerr << "<< " << m_size_list.size() << " buffers allocated, " << m_buffers_in_use << " buffers in use, "
-			  << (m_size_list.size() - m_buffers_in_use) << " buffers free." << std::endl;
-	std::cerr.flush();
-#endif
-	return buffer;
-}
+	}
+
+	uint8_t* m_base{nullptr};
+	size_t m_size{0};
+	size_t m_used{0};
+	bool m_huge_pages{false};
+};
+
+//----------------------------------------------------------------------------
+// BufferPool::MappedArena
 
-bool PersistentBuffer::buffer_in_use(PersistentBuffer::BufferPtr buffer)
+// a pool file holds a header, a table of records (one for each buffer carved
+// from the file), and then the storage itself.  everything is located by its
+// offset from the start of the file, so it can be mapped at any address
+static const uint64_t _mapped_magic{0x3152454646554250ull}; // "PBUFFER1"
+static const uint32_t _mapped_version{1};
+
+struct MappedHeader
 {
-	std::unique_lock<std::mutex> buffers_lock(m_buffers_lock);
-	return buffer.get() && buffer->m_in_use;
-}
+	uint64_t m_magic;
+	uint32_t m_version;
+	uint32_t m_record_capacity;
+	uint64_t m_size;
+	uint64_t m_data_offset;
+	// bytes of storage carved so far, and the records in use
+	uint64_t m_used;
+	uint32_t m_record_count;
+};
 
-void PersistentBuffer::garbage_collect(time_t start_time)
+struct BufferPool::MappedRecord
 {
-	std::vector<BufferPtr> buffers_to_drop;
+	uint64_t m_offset;
+	uint32_t m_allocated;
+	uint32_t m_data_size;
+	int64_t m_last_used;
+};
 
-	// TODO: map 'm_last_used' by age when 'm_cleanup_timeout' to speed up searching
-	for (BufferMapKey key : m_buffers)
+// like a Slab, storage is carved with a bump pointer, but the pointer lives
+// in the file.  the mapping (and the lock on the file) is released when the
+// last buffer referencing it is dropped
+struct BufferPool::MappedArena
+{
+	~MappedArena()
 	{
-		if (!key.first->m_in_use && (start_time - key.first->m_last_used) > m_cleanup_timeout)
-			buffers_to_drop.push_back(key.first); // drop this one, it's too old
+#ifndef _WIN32
+		if (m_base)
+			munmap(m_base, m_size);
+		if (m_fd >= 0)
+			close(m_fd);
+#endif
 	}
 
-	for (auto iter = buffers_to_drop.begin(); iter != buffers_to_drop.end(); ++iter)
+	// maps 'path', creating it at 'size' bytes if it is new.  returns false if
+	// it cannot be used
+	bool open(const std::string& path, size_t size)
 	{
-		m_buffers.erase(*iter);
-		m_size_list.erase(std::find(m_size_list.begin(), m_size_list.end(), *iter));
-	}
-	m_size_list.shrink_to_fit();
-}
+#ifdef _WIN32
+		(void)path;
+		(void)size;
+		return false;
+#else
+		m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+		if (m_fd < 0 || flock(m_fd, LOCK_EX | LOCK_NB) != 0)
+			return false;
 
-PersistentBuffer::BufferPtr PersistentBuffer::single_buffer_unprotected(uint32_t min_size)
-{
-	assert(m_initialized);
+		struct stat info;
+		if (fstat(m_fd, &info) != 0)
+			return false;
+		const bool created{info.st_size == 0};
+		if (created)
+		{
+			size = (size + _page_size - 1) & ~(_page_size - 1);
+			if (ftruncate(m_fd, static_cast<off_t>(size)) != 0)
+				return false;
+		}
+		else
+			size = static_cast<size_t>(info.st_size);
+		if (size < sizeof(MappedHeader))
+			return false;
 
-	// see if any existing free buffers match our 'min_size' requirement
+		void* base{mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0)};
+		if (base == MAP_FAILED)
+			return false;
+		m_base = static_cast<uint8_t*>(base);
+		m_size = size;
+		m_header = reinterpret_cast<MappedHeader*>(m_base);
 
-	auto iter = std::lower_bound(m_size_list.begin(), m_size_list.end(), min_size, [](const BufferPtr& buffer, uint32_t value) {
-		return buffer.get()->m_allocated < value;
-	});
+		if (created)
+		{
+			// a fresh file is zero-filled, so only the header is written; the
+			// magic goes last
+			uint64_t capacity{std::max<uint64_t>(size / 4096, 256)};
+			uint64_t data_offset{(sizeof(MappedHeader) + capacity * sizeof(MappedRecord) + _page_size - 1) & ~(_page_size - 1)};
+			if (data_offset >= size)
+				return false;
+			m_header->m_version = _mapped_version;
+			m_header->m_record_capacity = static_cast<uint32_t>(capacity);
+			m_header->m_size = size;
+			m_header->m_data_offset = data_offset;
+			m_header->m_magic = _mapped_magic;
+		}
 
-	while (iter != m_size_list.end() && (*iter)->m_in_use)
-		++iter;
+		return m_header->m_magic == _mapped_magic && m_header->m_version == _mapped_version && m_header->m_size == size &&
+			   m_header->m_data_offset >= sizeof(MappedHeader) + uint64_t{m_header->m_record_capacity} * sizeof(MappedRecord) &&
+			   m_header->m_data_offset + m_header->m_used <= size && m_header->m_record_count <= m_header->m_record_capacity;
+#endif
+	}
 
-	if (iter != m_size_list.end())
+	// returns nullptr if the file cannot hold 'bytes' more
+	uint8_t* carve(size_t bytes, size_t alignment)
 	{
-		BufferPtr buffer = *iter;
-		assert(buffer->m_allocated >= min_size);
-		buffer->m_in_use = true;
-		++m_buffers_in_use;
-		buffer->m_data_size = min_size;
-		++buffer->m_usage_count;
+		alignment = std::max(alignment, _slab_alignment);
+		auto offset{(m_header->m_data_offset + m_header->m_used + alignment - 1) & ~static_cast<uint64_t>(alignment - 1)};
+		if (offset + bytes > m_size)
+			return nullptr;
+		m_header->m_used = offset + bytes - m_header->m_data_offset;
+		return m_base + offset;
+	}
 
-		// this pathway is the main consumer of CPU time in PersistentBuffer, so
-		// invoking memset() here will TREMENDOUSLY impact performance (by multiple
-		// orders of magnitude--I kid you not).  if you need it, YOU enable it.
+	bool contains(const uint8_t* p) const { return p >= m_base && p < m_base + m_size; }
 
-#if 0
-		// 1,000,000 iterations: ~165ms -> ~11075ms
-		if (m_policies[Policy::ZeroBuffer])
-			memset(buffer->data().get(), 0, buffer->m_data_size);
-#endif
+	MappedRecord* records() const { return reinterpret_cast<MappedRecord*>(m_base + sizeof(MappedHeader)); }
 
-#if 0
-		// 1,000,000 iterations: ~165ms -> ~15383ms
-		if (m_policies[Policy::ZeroBuffer])
-			memset(buffer->data().get(), 0, buffer->m_allocated);
-#endif
+	// returns nullptr if the table is full; the buffer is then simply not
+	// restored when the file is next mapped
+	MappedRecord* add_record(const uint8_t* p, uint32_t allocated)
+	{
+		if (m_header->m_record_count == m_header->m_record_capacity)
+			return nullptr;
+		auto record{records() + m_header->m_record_count};
+		*record = MappedRecord{static_cast<uint64_t>(p - m_base), allocated, 0, 0};
+		// counted once it is complete
+		++m_header->m_record_count;
+		return record;
+	}
 
-		return buffer;
+	int m_fd{-1};
+	uint8_t* m_base{nullptr};
+	size_t m_size{0};
+	MappedHeader* m_header{nullptr};
+};
+
+//----------------------------------------------------------------------------
+// BufferPool::FixedPool
+
+// a Treiber stack of pre-allocated buffers.  the head packs the index of the
+// top slot into the low 32 bits and a modification tag into the high 32
+// bits; every successful push or pop advances the tag, so a head that was
+// popped and pushed back between our load and our compare-exchange no
+// longer compares equal (no ABA).
+struct BufferPool::FixedPool
+{
+	static const uint32_t empty{0xFFFFFFFF};
+
+	FixedPool(BufferPool& pool, int32_t id, uint32_t size, uint32_t count, bool zero) :
+		m_size(size),
+		m_buffers(count),
+		m_next(new std::atomic<uint32_t>[count])
+	{
+		for (uint32_t slot = 0; slot < count; ++slot)
+		{
+			BufferPtr buffer = std::make_shared<Buffer>();
+			buffer->m_allocated = size;
+			buffer->m_fixed_pool = id;
+			buffer->m_fixed_slot = slot;
+			buffer->m_pool = &pool;
+			bool zeroed{false};
+			buffer->m_buffer = pool.allocate_storage(size, -1, zeroed);
+			if (zero && !zeroed)
+				memset(buffer->m_buffer.get(), 0, size);
+			buffer->m_zeroed = zero || zeroed;
+			m_buffers[slot] = buffer;
+
+			m_next[slot].store((slot + 1 < count) ? slot + 1 : empty, std::memory_order_relaxed);
+		}
+		m_head.store(count ? 0 : empty, std::memory_order_release);
 	}
 
-	// if we reach here, there are no free buffers, or there are none that match 'min_size'
-	BufferPtr buffer = std::make_shared<Buffer>();
-	buffer->m_in_use = true;
-	++buffer->m_usage_count;
-	buffer->m_allocated = min_size;
-	buffer->m_data_size = min_size;
-	buffer->m_buffer = Buffer::DataPtr(new uint8_t[min_size], [](uint8_t* p) {
-		delete[] p;
-	});
-	// invoking memset() here doesn't appear to have a noticible impact on performance
-	if (m_policies[Policy::ZeroBuffer])
-		memset(buffer->rw(), 0, buffer->m_allocated);
+	~FixedPool()
+	{
+		// anything still held by a caller becomes inert, as with reset()
+		for (auto& buffer : m_buffers)
+			buffer->reset();
+	}
 
-	m_buffers[buffer] = true;
-	++m_buffers_in_use;
+	Buffer* pop()
+	{
+		uint64_t head{m_head.load(std::memory_order_acquire)};
+		for (;;)
+		{
+			auto slot{static_cast<uint32_t>(head)};
+			if (slot == empty)
+				return nullptr;
 
-	m_size_list.push_back(buffer);
-	std::sort(m_size_list.begin(), m_size_list.end(), [](const BufferPtr& a, const BufferPtr& b) {
-		return a->m_allocated < b->m_allocated;
-	});
+			uint64_t next{(((head >> 32) + 1) << 32) | m_next[slot].load(std::memory_order_relaxed)};
+			if (m_head.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire))
+				return m_buffers[slot].get();
+		}
+	}
 
-	// do garbage collection, if indicated
-	if (m_policies[Policy::DropOld] && m_cleanup_timeout)
+	void push(uint32_t slot)
 	{
-		time_t now = time(nullptr);
-		if ((now - m_last_cleanup_check) > m_cleanup_timeout)
+		uint64_t head{m_head.load(std::memory_order_relaxed)};
+		for (;;)
 		{
-			m_last_cleanup_check = now;
-			garbage_collect(now);
+			m_next[slot].store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+
+			uint64_t next{(((head >> 32) + 1) << 32) | slot};
+			if (m_head.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed))
+				return;
 		}
 	}
 
-	return buffer;
+	const uint32_t m_size;
+	std::vector<BufferPtr> m_buffers;
+	std::unique_ptr<std::atomic<uint32_t>[]> m_next;
+	std::atomic<uint64_t> m_head{empty};
+	// acquisitions this pool has satisfied
+	std::atomic<uint64_t> m_hits{0};
+};
+
+//----------------------------------------------------------------------------
+// BufferPool::Buffer methods
+
+uint8_t const * const BufferPool::Buffer::ro() const
+{
+	if (m_in_use)
+		return m_buffer.get();
+
+	assert(false);
+	return nullptr;
 }
 
-bool PersistentBuffer::release_buffer(PersistentBuffer::BufferPtr buffer
-#if PERSISTENTBUFFER_TRACKING >= 2
-	, const tracking_data_t &caller
-#endif
-)
+uint8_t * const BufferPool::Buffer::rw() const
 {
-	if (buffer.get() && buffer->m_in_use)
+	if (m_in_use)
+		return m_buffer.get();
+
+	assert(false);
+	return nullptr;
+}
+
+//----------------------------------------------------------------------------
+// BufferPool::ScopedBuffer and BufferPool::BufferHandle methods
+
+void BufferPool::ScopedBuffer::reset()
+{
+	if (m_buffer)
 	{
-		auto p{buffer->ro()};
-
-		std::unique_lock<std::mutex> buffers_lock(m_buffers_lock);
-
-#if PERSISTENTBUFFER_TRACKING >= 2
-		if (!caller.first.empty()) {
-			auto key{static_cast<const void *>(p)};
-			if (_tracking_map.find(key) == _tracking_map.end())
-			std::cerr << "!!! FAILED to locate " << key
-						<< " in tracking map." << std::endl;
-			else {
-			std::cerr << "--- buffer " << key << " released by "
-						<< caller.first << ":" << caller.second << "."
-						<< std::endl;
-			_tracking_map.erase(key);
-			}
-			std::cerr.flush();
-		}
+		BufferPool::release_pinned(m_buffer);
+		m_buffer = nullptr;
+	}
+}
+
+BufferPool::BufferHandle::BufferHandle(ScopedBuffer&& scoped) : m_buffer(scoped.m_buffer)
+{
+	scoped.m_buffer = nullptr;
+	if (m_buffer)
+		m_buffer->m_refs.store(1, std::memory_order_relaxed);
+}
+
+BufferPool::BufferHandle::BufferHandle(BufferPtr&& buffer) : m_buffer(buffer.get())
+{
+	if (m_buffer)
+	{
+		// as with scoped_buffer(), the pin keeps the buffer alive for us
+		assert(m_buffer->m_in_use && !m_buffer->m_pin);
+		m_buffer->m_pin = std::move(buffer);
+		m_buffer->m_refs.store(1, std::memory_order_relaxed);
+	}
+}
+
+void BufferPool::BufferHandle::reset()
+{
+	if (m_buffer)
+	{
+		if (m_buffer->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			BufferPool::release_pinned(m_buffer);
+		m_buffer = nullptr;
+	}
+}
+
+//----------------------------------------------------------------------------
+// BufferPool::BufferChain methods
+
+void BufferPool::BufferChain::append(BufferPtr buffer)
+{
+	assert(buffer && buffer->m_in_use);
+	assert(m_segments.empty() || buffer->m_pool == m_segments.front()->m_pool);
+
+	m_bytes += buffer->m_data_size;
+#ifndef _WIN32
+	m_iov.push_back(iovec{buffer->m_buffer.get(), buffer->m_data_size});
 #endif
+	m_segments.push_back(std::move(buffer));
+}
 
-		m_buffers[buffer] = true;
+void BufferPool::BufferChain::reset()
+{
+	// segments made inert by reset() (or by their pool going away) are not
+	// returned to anything
+	auto live = std::find_if(m_segments.begin(), m_segments.end(), [](const BufferPtr& buffer) {
+		return buffer->m_in_use;
+	});
+	if (live != m_segments.end())
+		(*live)->m_pool->release_buffers(m_segments);
 
-		buffer->m_in_use = false;
-		--m_buffers_in_use;
-		buffer->m_last_used = time(nullptr);
-#if PERSISTENTBUFFER_TRACKING == 1 || PERSISTENTBUFFER_TRACKING == 3
-		std::cerr << "<< " << m_size_list.size() << " buffers allocated, " << m_buffers_in_use << " buffers in use, "
-				<< (m_size_list.size() - m_buffers_in_use) << " buffers free." << std::endl;
-		std::cerr.flush();
+	m_segments.clear();
+#ifndef _WIN32
+	m_iov.clear();
 #endif
+	m_bytes = 0;
+}
+
+//----------------------------------------------------------------------------
+// BufferPool methods
+
+BufferPool::BufferPool() : m_id(_next_pool_id.fetch_add(1, std::memory_order_relaxed)), m_reclaimer(new ReclaimerState)
+{
+	m_layout_id = _next_layout_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+BufferPool::~BufferPool()
+{
+	stop_reclaimer();
+
+	// threads that still have a cache for this pool find it detached when
+	// they next look, or when they exit
+	{
+		std::lock_guard<std::mutex> caches_lock(_caches_lock);
+		auto buffers_lock{lock_buffers()};
+		for (auto cache : m_thread_caches)
+			cache->m_pool.store(nullptr, std::memory_order_release);
+		m_thread_caches.clear();
+
+		// queued requests go unanswered
+		m_pending_acquisitions.clear();
+		m_capacity_demand = 0;
 	}
-	return true;
+
+	// anything still held by a caller becomes inert
+	reset();
 }
 
-bool PersistentBuffer::release_buffers(const std::vector<PersistentBuffer::BufferPtr>& buffers
-#if PERSISTENTBUFFER_TRACKING >= 2
-	, const tracking_data_t& caller
-#endif
-)
+void BufferPool::initialize(BinLayout layout, double spacing)
 {
-	std::unique_lock<std::mutex> buffers_lock(m_buffers_lock);
+	std::vector<uint32_t> sizes;
 
-	for (BufferPtr buffer : buffers)
+	switch (layout)
 	{
-		if (buffer.get() && buffer->m_in_use)
+		case BinLayout::None:
+			break;
+
+		case BinLayout::PowerOfTwo:
+			for (uint64_t size = _min_bin_size; size <= _max_bin_size; size <<= 1)
+				sizes.push_back(static_cast<uint32_t>(size));
+			break;
+
+		case BinLayout::Geometric:
 		{
-#if PERSISTENTBUFFER_TRACKING >= 2
-			if (!caller.first.empty())
+			spacing = std::max(spacing, 1.01);
+			for (uint64_t size = _min_bin_size; size <= _max_bin_size;)
 			{
-				auto key{static_cast<const void*>(buffer->ro())};
-				if (_tracking_map.find(key) == _tracking_map.end())
-					std::cerr << "!!! FAILED to locate " << key << " in tracking map." << std::endl;
-				else
-				{
-					std::cerr << "--- buffer " << key << " released by " << caller.first << ":" << caller.second << "." << std::endl;
-					_tracking_map.erase(key);
-				}
-				std::cerr.flush();
+				sizes.push_back(static_cast<uint32_t>(size));
+				auto next{static_cast<uint64_t>(std::ceil(size * spacing))};
+				next = (next + _min_bin_size - 1) & ~static_cast<uint64_t>(_min_bin_size - 1);
+				size = std::max(next, size + _min_bin_size);
 			}
-#endif
-			buffer->m_in_use = false;
-			--m_buffers_in_use;
-			buffer->m_last_used = time(nullptr);
+			break;
 		}
 	}
-#if PERSISTENTBUFFER_TRACKING == 1 || PERSISTENTBUFFER_TRACKING == 3
-	std::cerr << "<< " << m_size_list.size() << " buffers allocated, " << m_buffers_in_use << " buffers in use, "
-			  << (m_size_list.size() - m_buffers_in_use) << " buffers free." << std::endl;
-	std::cerr.flush();
-#endif
-	return true;
+
+	initialize(sizes);
+}
+
+void BufferPool::initialize(const std::vector<uint32_t>& size_classes)
+{
+	m_policies.set(Policy::ZeroBuffer);
+
+	{
+		auto buffers_lock{lock_buffers()};
+		build_bins(size_classes);
+	}
+
+	m_initialized = true;
+}
+
+uint32_t BufferPool::size_class(uint32_t min_size)
+{
+	auto bin{bin_index(min_size)};
+	return (bin < 0) ? min_size : m_bins[bin].m_size;
+}
+
+void BufferPool::set_cleanup_timeout(time_t seconds)
+{
+	m_cleanup_timeout = seconds;
+	m_last_cleanup_check = time(nullptr);
+	set_policy(Policy::DropOld);
+}
+
+void BufferPool::set_policy(Policy policy)
+{
+	m_policies.set(policy);
+}
+
+void BufferPool::set_policy(std::initializer_list<Policy> policies)
+{
+	for (Policy p : policies)
+		m_policies.set(p);
+}
+
+void BufferPool::clear_policy(Policy policy)
+{
+	m_policies.reset(policy);
+}
+
+void BufferPool::set_thread_cache_capacity(size_t buffers)
+{
+	m_thread_cache_capacity = std::max<size_t>(buffers, 2);
+}
+
+void BufferPool::flush_thread_cache()
+{
+	auto& cache{thread_cache()};
+	remote_drain(cache);
+
+	{
+		auto buffers_lock{lock_buffers()};
+		thread_cache_spill(cache, cache.m_buffers.size());
+	}
+	if (m_capacity_demand.load(std::memory_order_relaxed))
+		capacity_released();
+}
+
+BufferPool::CacheStatistics BufferPool::cache_statistics()
+{
+	auto buffers_lock{lock_buffers()};
+
+	CacheStatistics stats{m_retired_stats};
+	for (auto cache : m_thread_caches)
+	{
+		stats.local_hits += cache->m_local_hits.load(std::memory_order_relaxed);
+		stats.remote_releases += cache->m_remote_releases.load(std::memory_order_relaxed);
+		stats.remote_drains += cache->m_remote_drains.load(std::memory_order_relaxed);
+	}
+	stats.global_hits += m_global_hits.load(std::memory_order_relaxed);
+	stats.misses += m_misses.load(std::memory_order_relaxed);
+	stats.spills += m_spills.load(std::memory_order_relaxed);
+	stats.refills += m_refills.load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+void BufferPool::reset()
+{
+	auto buffers_lock{lock_buffers()};
+
+	m_policies.reset();
+	m_policies.set(Policy::ZeroBuffer);
+	for (const BufferPtr& buffer : m_buffers)
+	{
+		if (buffer)
+			buffer->reset();
+	}
+	m_buffers.clear();
+	m_free_slots.clear();
+	m_buffer_count = 0;
+	m_pooled_bytes = 0;
+	m_size_list.clear();
+	m_scrub_list.clear();
+	m_oldest = m_newest = nullptr;
+	// the thread caches' usage counts are only written by their threads, so
+	// the pool's are set to cancel them out
+	UsageTotals cancel;
+	for (auto cache : m_thread_caches)
+	{
+		cancel.m_buffers -= cache->m_buffers_in_use.load(std::memory_order_relaxed);
+		cancel.m_requested_bytes -= cache->m_requested_bytes.load(std::memory_order_relaxed);
+		cancel.m_in_use_bytes -= cache->m_in_use_bytes.load(std::memory_order_relaxed);
+		for (int i = 0; i < demand_buckets; ++i)
+			cache->m_demand_folded[i] = cache->m_demand[i].load(std::memory_order_relaxed);
+	}
+	m_buffers_in_use = cancel.m_buffers;
+	m_requested_bytes = cancel.m_requested_bytes;
+	m_in_use_bytes = cancel.m_in_use_bytes;
+	for (auto& count : m_demand)
+		count.store(0, std::memory_order_relaxed);
+	m_last_decay = 0;
+	m_last_fold = 0;
+	for (auto& bin : m_bins)
+	{
+		bin.m_free.fill(nullptr);
+		bin.m_free_count = 0;
+		bin.m_count = 0;
+	}
+
+	// any buffers still parked in thread caches are now stale, as are those
+	// waiting in return queues
+	++m_generation;
+	for (auto& queue : m_remote_queues)
+	{
+		// a closed queue stays closed
+		auto head{queue->m_head.load(std::memory_order_relaxed)};
+		while (head != RemoteQueue::closed() && !queue->m_head.compare_exchange_weak(head, nullptr, std::memory_order_relaxed))
+			;
+		queue->m_count.store(0, std::memory_order_relaxed);
+	}
+
+	m_fixed_pool_count = 0;
+	m_fixed_buffer_count = 0;
+	for (auto& pool : m_fixed_pools)
+		pool.reset();
+
+	// the slabs go with the last of their buffers, as does the pool file
+	for (auto& slab : m_current_slabs)
+		slab.reset();
+	m_mapped_arena.reset();
+
+	buffers_lock.unlock();
+	if (m_capacity_demand.load(std::memory_order_relaxed))
+		capacity_released();
+}
+
+void BufferPool::set_arena(size_t slab_size, bool huge_pages)
+{
+	auto buffers_lock{lock_buffers()};
+
+	m_slab_size = std::max<size_t>(slab_size, 64 * 1024);
+	m_huge_pages = huge_pages;
+	// start carving from a slab with the new settings
+	for (auto& slab : m_current_slabs)
+		slab.reset();
+
+	m_policies.set(Policy::Arena);
+}
+
+bool BufferPool::map_arena(const std::string& path, size_t size)
+{
+	auto arena{std::make_shared<MappedArena>()};
+	if (!arena->open(path, size))
+		return false;
+
+	// the buffers a previous owner carved come back as free buffers, with
+	// their contents; a damaged record is skipped
+	std::vector<BufferPtr> restored;
+	auto records{arena->records()};
+	for (uint32_t i = 0; i < arena->m_header->m_record_count; ++i)
+	{
+		auto& record{records[i]};
+		if (record.m_offset < arena->m_header->m_data_offset || record.m_offset + record.m_allocated > arena->m_size)
+			continue;
+
+		BufferPtr buffer = std::make_shared<Buffer>();
+		buffer->m_pool = this;
+		buffer->m_allocated = record.m_allocated;
+		buffer->m_data_size = std::min(record.m_data_size, record.m_allocated);
+		buffer->m_buffer = Buffer::DataPtr(arena, arena->m_base + record.m_offset);
+		buffer->m_record = &record;
+		restored.push_back(std::move(buffer));
+	}
+
+	auto buffers_lock{lock_buffers()};
+	if (m_capacity_bytes || m_capacity_class_buffers)
+	{
+		// as in pool_free_buffers(), only an exact fit joins a class
+		size_t bytes{0};
+		std::vector<size_t> class_counts(m_bins.size());
+		for (const auto& buffer : restored)
+		{
+			bytes += buffer->m_allocated;
+			auto bin{bin_index(buffer->m_allocated)};
+			if (bin >= 0 && m_bins[bin].m_size == buffer->m_allocated)
+				++class_counts[bin];
+		}
+		if (!make_room(bytes, class_counts))
+			return false;
+	}
+	// restored buffers are stamped as released now; they should not all be
+	// collected at once for the time the process was down
+	pool_free_buffers(restored, clock_now());
+	m_mapped_arena = std::move(arena);
+	m_policies.set(Policy::Arena);
+
+	return true;
+}
+
+int64_t BufferPool::mapped_offset(const BufferPtr& buffer)
+{
+	// the record is fixed while the buffer holds its storage
+	if (!buffer.get() || !buffer->m_record)
+		return -1;
+	return static_cast<int64_t>(buffer->m_record->m_offset);
+}
+
+void BufferPool::update_record(Buffer* buffer, time_t now)
+{
+	buffer->m_record->m_data_size = buffer->m_data_size;
+	buffer->m_record->m_last_used = static_cast<int64_t>(now);
+}
+
+void BufferPool::set_alignment(size_t alignment)
+{
+	assert((alignment & (alignment - 1)) == 0);
+
+	auto buffers_lock{lock_buffers()};
+	m_alignment = alignment;
+}
+
+uint32_t BufferPool::current_node()
+{
+#ifdef _WIN32
+	PROCESSOR_NUMBER processor;
+	GetCurrentProcessorNumberEx(&processor);
+	USHORT node{0};
+	if (!GetNumaProcessorNodeEx(&processor, &node))
+		return 0;
+	return node % max_numa_nodes;
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+	// glibc answers this from the vDSO, without entering the kernel
+	unsigned cpu{0}, node{0};
+	if (getcpu(&cpu, &node) != 0)
+		return 0;
+	return node % max_numa_nodes;
+#elif defined(SYS_getcpu)
+	// the raw system call is a kernel entry, so its answer is kept for a
+	// while; a thread that migrates is only briefly served from the old node
+	thread_local uint32_t node{0};
+	thread_local uint32_t lookups{0};
+	if (lookups++ % node_refresh_interval == 0)
+	{
+		unsigned cpu{0}, current{0};
+		node = (syscall(SYS_getcpu, &cpu, &current, nullptr) == 0) ? current % max_numa_nodes : 0;
+	}
+	return node;
+#else
+	return 0;
+#endif
+}
+
+BufferPool::Buffer::DataPtr BufferPool::allocate_storage(uint32_t size, int32_t node, bool& zeroed, Slab** dedicated)
+{
+	zeroed = false;
+
+	if (m_policies[Policy::Arena])
+	{
+		if (m_mapped_arena)
+		{
+			// storage in the file has never been handed out, so it is still
+			// zero-filled
+			auto p{m_mapped_arena->carve(size, m_alignment)};
+			if (p)
+			{
+				zeroed = true;
+				return Buffer::DataPtr(m_mapped_arena, p);
+			}
+			// the file is full; carry on with ordinary slabs
+		}
+
+		std::shared_ptr<Slab> slab;
+		uint8_t* p{nullptr};
+
+		if (size > m_slab_size / 2)
+		{
+			// too big to share a slab; give it its own mapping
+			slab = std::make_shared<Slab>(size, m_huge_pages, node);
+			p = slab->carve(size, m_alignment);
+			if (p && dedicated)
+				*dedicated = slab.get();
+		}
+		else
+		{
+			auto& current{m_current_slabs[(node < 0) ? 0 : node]};
+			if (current)
+				p = current->carve(size, m_alignment);
+			if (!p)
+			{
+				current = std::make_shared<Slab>(m_slab_size, m_huge_pages, node);
+				p = current->carve(size, m_alignment);
+			}
+			slab = current;
+		}
+
+		if (p)
+		{
+			// anonymous mappings are zero-filled, and slab storage is never reused
+			zeroed = true;
+			// alias the slab's reference count; no per-buffer control block
+			return Buffer::DataPtr(slab, p);
+		}
+
+		// the mapping failed; fall back to the heap
+	}
+
+	if (m_alignment > alignof(std::max_align_t))
+	{
+		void* p{nullptr};
+#ifdef _WIN32
+		p = _aligned_malloc(size ? size : 1, m_alignment);
+		if (!p)
+			throw std::bad_alloc();
+		return Buffer::DataPtr(static_cast<uint8_t*>(p), [](uint8_t* p) {
+			_aligned_free(p);
+		});
+#else
+		if (posix_memalign(&p, m_alignment, size ? size : 1) != 0)
+			throw std::bad_alloc();
+		return Buffer::DataPtr(static_cast<uint8_t*>(p), [](uint8_t* p) {
+			free(p);
+		});
+#endif
+	}
+
+	// heap storage is placed on whichever node first touches it, which for a
+	// new buffer is normally the thread that asked for it
+	return Buffer::DataPtr(new uint8_t[size], [](uint8_t* p) {
+		delete[] p;
+	});
+}
+
+bool BufferPool::register_fixed_pool(uint32_t size, uint32_t count)
+{
+	auto buffers_lock{lock_buffers()};
+
+	auto id{m_fixed_pool_count.load()};
+	if (id == max_fixed_pools)
+		return false;
+	for (int i = 0; i < id; ++i)
+	{
+		if (m_fixed_pools[i]->m_size == size)
+			return false;
+	}
+
+	m_fixed_pools[id].reset(new FixedPool(*this, id, size, count, m_policies[Policy::ZeroBuffer]));
+	m_fixed_pool_count.store(id + 1, std::memory_order_release);
+	m_fixed_buffer_count += count;
+
+	return true;
+}
+
+bool BufferPool::reserve(const std::vector<Reservation>& reservations, bool prefault)
+{
+	const bool numa{m_policies[Policy::NumaAware]};
+	const uint32_t node{acquire_node()};
+
+	// the storage is allocated under the lock, as on the miss path...
+	std::vector<BufferPtr> reserved;
+	{
+		auto buffers_lock{lock_buffers()};
+		if (m_capacity_bytes || m_capacity_class_buffers)
+		{
+			size_t bytes{0};
+			std::vector<size_t> class_counts(m_bins.size());
+			for (const auto& reservation : reservations)
+			{
+				auto bin{bin_index(reservation.size)};
+				bytes += size_t{(bin >= 0) ? m_bins[bin].m_size : reservation.size} * reservation.count;
+				if (bin >= 0)
+					class_counts[bin] += reservation.count;
+			}
+			if (!make_room(bytes, class_counts))
+				return false;
+		}
+		for (const auto& reservation : reservations)
+		{
+			auto bin{bin_index(reservation.size)};
+			uint32_t allocated{(bin >= 0) ? m_bins[bin].m_size : reservation.size};
+			for (uint32_t i = 0; i < reservation.count; ++i)
+			{
+				BufferPtr buffer = std::make_shared<Buffer>();
+				buffer->m_pool = this;
+				buffer->m_allocated = allocated;
+				buffer->m_node = static_cast<uint8_t>(node);
+				buffer->m_buffer = allocate_storage(allocated, numa ? static_cast<int32_t>(node) : -1, buffer->m_zeroed, &buffer->m_slab);
+				reserved.push_back(std::move(buffer));
+			}
+		}
+	}
+
+	// ...but nothing else can see it yet, so it is touched without the lock
+	for (auto& buffer : reserved)
+	{
+		auto p{buffer->m_buffer.get()};
+		if (m_policies[Policy::ZeroBuffer] && !buffer->m_zeroed)
+		{
+			// this faults every page in as well
+			zero_storage(p, buffer->m_allocated);
+			buffer->m_zeroed = true;
+		}
+		else if (prefault)
+		{
+			// it takes a write; a read would only map the shared zero page
+			for (size_t offset = 0; offset < buffer->m_allocated; offset += _page_size)
+				p[offset] = 0;
+		}
+	}
+
+	auto buffers_lock{lock_buffers()};
+	pool_free_buffers(reserved, clock_now());
+	return true;
+}
+
+void BufferPool::pool_free_buffers(std::vector<BufferPtr>& buffers, time_t now)
+{
+	auto sorted{m_size_list.size()};
+	for (auto& buffer : buffers)
+	{
+		// a buffer only joins a size class it fits exactly; the layout may not
+		// be the one its storage was sized for
+		auto bin{bin_index(buffer->m_allocated)};
+		buffer->m_bin = (bin >= 0 && m_bins[bin].m_size == buffer->m_allocated) ? bin : -1;
+		buffer->m_last_used = now;
+		register_buffer(buffer);
+		if (buffer->m_bin >= 0)
+			bin_push(buffer.get());
+		else
+			m_size_list.push_back(buffer);
+		age_push(buffer.get());
+	}
+
+	// the exact-size buffers are merged into the index in one pass, rather than
+	// inserted one at a time
+	auto by_size = [](const BufferPtr& a, const BufferPtr& b) {
+		return a->m_allocated < b->m_allocated;
+	};
+	std::stable_sort(m_size_list.begin() + sorted, m_size_list.end(), by_size);
+	std::inplace_merge(m_size_list.begin(), m_size_list.begin() + sorted, m_size_list.end(), by_size);
+}
+
+std::vector<BufferPool::Reservation> BufferPool::reservation_profile()
+{
+	std::vector<uint32_t> sizes;
+	{
+		auto buffers_lock{lock_buffers()};
+		sizes.reserve(m_buffer_count);
+		for (const BufferPtr& buffer : m_buffers)
+		{
+			if (buffer)
+				sizes.push_back(buffer->m_allocated);
+		}
+	}
+	std::sort(sizes.begin(), sizes.end());
+
+	std::vector<Reservation> profile;
+	for (auto size : sizes)
+	{
+		if (profile.empty() || profile.back().size != size)
+			profile.push_back(Reservation{size, 0});
+		++profile.back().count;
+	}
+
+	return profile;
+}
+
+bool BufferPool::save_reservation_profile(const std::string& path)
+{
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	for (const auto& reservation : reservation_profile())
+		file << reservation.size << ' ' << reservation.count << '\n';
+	file.close();
+
+	return !file.fail();
+}
+
+bool BufferPool::load_reservation_profile(const std::string& path, bool prefault)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	std::vector<Reservation> reservations;
+	Reservation reservation;
+	while (file >> reservation.size >> reservation.count)
+		reservations.push_back(reservation);
+	// anything but a clean end of file means the profile is malformed
+	if (!file.eof())
+		return false;
+
+	return reserve(reservations, prefault);
+}
+
+BufferPool::BufferPtr BufferPool::acquire(uint32_t min_size, bool zero, int32_t bin)
+{
+	auto buffer{try_acquire(min_size, zero, bin)};
+	if (!buffer)
+		throw std::bad_alloc(); // the pool is at its capacity
+	return buffer;
+}
+
+BufferPool::BufferPtr BufferPool::try_acquire(uint32_t min_size, bool zero, int32_t bin)
+{
+	BufferPtr buffer;
+	if (m_fixed_pool_count.load(std::memory_order_relaxed))
+		buffer = fixed_pool_acquire(min_size);
+
+	if (!buffer)
+	{
+		if (m_policies[Policy::ThreadCache])
+			buffer = thread_cache_acquire(min_size, bin);
+		else
+		{
+			const uint32_t node{acquire_node()};
+			auto buffers_lock{lock_buffers()};
+			buffer = single_buffer_unprotected(min_size, node, nullptr, bin);
+		}
+	}
+
+	if (buffer)
+		finish_acquire(buffer.get(), zero);
+	return buffer;
+}
+
+BufferPool::BufferPtr BufferPool::acquire_sized(uint32_t min_size, SizedCache& cached_bins, bool zero)
+{
+	// the layout id and the class are packed together, so that they are
+	// always read as a pair; layout ids are distinct across pools, so a
+	// slot shared with another pool is never mistaken for ours
+	auto& cached_bin{cached_bins[m_id % sized_cache_slots]};
+	auto layout{m_layout_id.load(std::memory_order_acquire)};
+	auto entry{cached_bin.load(std::memory_order_relaxed)};
+	int32_t bin;
+	if ((entry >> 32) == layout)
+		bin = static_cast<int32_t>(static_cast<uint32_t>(entry));
+	else
+	{
+		bin = bin_index(min_size);
+		cached_bin.store((uint64_t{layout} << 32) | static_cast<uint32_t>(bin), std::memory_order_relaxed);
+	}
+
+	auto buffer{acquire(min_size, zero, bin)};
+	if (m_policies[Policy::UsageReport])
+		report_usage();
+	return buffer;
+}
+
+void BufferPool::finish_acquire(Buffer* buffer, bool zero)
+{
+	// the buffer is ours alone now, so it is zeroed without holding the lock,
+	// and only as far as the caller was promised
+	if (zero && m_policies[Policy::ZeroBuffer] && !buffer->m_zeroed)
+		zero_storage(buffer->m_buffer.get(), buffer->m_data_size);
+	buffer->m_zeroed = false;
+
+	// a buffer from the thread-cache tier is handed back to this thread,
+	// wherever it is released (see thread_cache_release())
+	if (buffer->m_cached)
+		buffer->m_owner = thread_cache().m_remote;
+
+	count_in_use(buffer, true);
+}
+
+void BufferPool::count_in_use(const Buffer* buffer, bool acquired)
+{
+	// a thread with a cache counts in it, so that threads on the tiers that
+	// avoid the lock do not all write the same cache lines
+	auto cache{last_thread_cache()};
+	if (cache && cache->m_pool_id != m_id)
+		cache = nullptr;
+
+	if (acquired)
+	{
+		if (cache)
+		{
+			bump(cache->m_buffers_in_use);
+			bump(cache->m_requested_bytes, buffer->m_data_size);
+			bump(cache->m_in_use_bytes, buffer->m_allocated);
+			bump(cache->m_size_histogram[histogram_bucket(buffer->m_data_size)]);
+			if (m_policies[Policy::AdaptiveSizing])
+				bump(cache->m_demand[demand_bucket(buffer->m_data_size)]);
+		}
+		else
+		{
+			m_buffers_in_use.fetch_add(1, std::memory_order_relaxed);
+			m_requested_bytes.fetch_add(buffer->m_data_size, std::memory_order_relaxed);
+			m_in_use_bytes.fetch_add(buffer->m_allocated, std::memory_order_relaxed);
+			m_size_histogram[histogram_bucket(buffer->m_data_size)].fetch_add(1, std::memory_order_relaxed);
+			if (m_policies[Policy::AdaptiveSizing])
+				m_demand[demand_bucket(buffer->m_data_size)].fetch_add(1, std::memory_order_relaxed);
+		}
+
+		PERSISTENTBUFFER_PROBE4(acquire, m_id, buffer, buffer->m_data_size, buffer->m_allocated);
+		trace(TraceEvent::Acquire, buffer, buffer->m_data_size, buffer->m_allocated);
+	}
+	else
+	{
+		// the byte counts wrap below zero on a thread that releases more than
+		// it acquires; the sum over all threads comes out right
+		if (cache)
+		{
+			bump(cache->m_buffers_in_use, -1);
+			bump(cache->m_requested_bytes, uint64_t{0} - buffer->m_data_size);
+			bump(cache->m_in_use_bytes, uint64_t{0} - buffer->m_allocated);
+		}
+		else
+		{
+			m_buffers_in_use.fetch_sub(1, std::memory_order_relaxed);
+			m_requested_bytes.fetch_sub(buffer->m_data_size, std::memory_order_relaxed);
+			m_in_use_bytes.fetch_sub(buffer->m_allocated, std::memory_order_relaxed);
+		}
+
+		PERSISTENTBUFFER_PROBE4(release, m_id, buffer, buffer->m_data_size, buffer->m_allocated);
+		trace(TraceEvent::Release, buffer, buffer->m_data_size, buffer->m_allocated);
+	}
+}
+
+BufferPool::UsageTotals BufferPool::usage_unprotected()
+{
+	UsageTotals totals;
+	totals.m_buffers = m_buffers_in_use.load(std::memory_order_relaxed);
+	totals.m_requested_bytes = m_requested_bytes.load(std::memory_order_relaxed);
+	totals.m_in_use_bytes = m_in_use_bytes.load(std::memory_order_relaxed);
+	for (auto cache : m_thread_caches)
+	{
+		totals.m_buffers += cache->m_buffers_in_use.load(std::memory_order_relaxed);
+		totals.m_requested_bytes += cache->m_requested_bytes.load(std::memory_order_relaxed);
+		totals.m_in_use_bytes += cache->m_in_use_bytes.load(std::memory_order_relaxed);
+	}
+	// the counts are read one by one while other threads move buffers about
+	if (totals.m_buffers < 0)
+		totals.m_buffers = 0;
+	return totals;
+}
+
+size_t BufferPool::buffers_in_use()
+{
+	auto buffers_lock{lock_buffers()};
+	return static_cast<size_t>(usage_unprotected().m_buffers);
+}
+
+uint32_t BufferPool::slack_limit(uint32_t min_size)
+{
+	if (!m_max_slack)
+		return UINT32_MAX;
+
+	auto slack{std::max<uint64_t>(static_cast<uint64_t>(min_size) * m_max_slack / 100, _min_bin_size)};
+	return static_cast<uint32_t>(std::min<uint64_t>(min_size + slack, UINT32_MAX));
+}
+
+uint32_t BufferPool::adaptive_size(uint32_t min_size)
+{
+	decay_demand(clock_now());
+
+	auto bucket{demand_bucket(min_size)};
+	uint64_t demand{m_demand[bucket].load(std::memory_order_relaxed)};
+	uint64_t total{0};
+	for (const auto& count : m_demand)
+		total += count.load(std::memory_order_relaxed);
+
+	// sizes that are seldom asked for are allocated exactly; a popular one is
+	// rounded up so that the buffer fits any later request in its step
+	if (demand < 2 || demand * _popular_share < total)
+		return min_size;
+	return static_cast<uint32_t>(std::min<uint64_t>(demand_bucket_top(bucket), slack_limit(min_size)));
+}
+
+uint64_t BufferPool::served_demand(const Buffer* buffer)
+{
+	// the smallest request that could be given this buffer: anything above
+	// the next class down, or within the slack limit of its size
+	uint64_t lowest;
+	if (buffer->m_bin >= 0)
+		lowest = buffer->m_bin ? m_bins[buffer->m_bin - 1].m_size + 1 : 1;
+	else if (m_max_slack)
+		lowest = static_cast<uint64_t>(buffer->m_allocated) * 100 / (100 + m_max_slack);
+	else
+		lowest = buffer->m_allocated / 2 + 1;
+
+	uint64_t demand{0};
+	auto last{demand_bucket(buffer->m_allocated)};
+	for (auto bucket = demand_bucket(static_cast<uint32_t>(std::max<uint64_t>(lowest, 1))); bucket <= last; ++bucket)
+		demand += m_demand[bucket].load(std::memory_order_relaxed);
+	return demand;
+}
+
+void BufferPool::decay_demand(time_t now)
+{
+	fold_demand(now);
+
+	// halved once per cleanup timeout (or second, without one), so that a
+	// size falls out of favor within a few timeouts of its last request
+	const time_t half_life{std::max<time_t>(m_cleanup_timeout, 1)};
+	if (now - m_last_decay < half_life)
+		return;
+
+	auto halvings{std::min<time_t>((now - m_last_decay) / half_life, 63)};
+	m_last_decay = now;
+	for (auto& count : m_demand)
+		count.store(count.load(std::memory_order_relaxed) >> halvings, std::memory_order_relaxed);
+}
+
+// adds what the thread caches have counted since the last fold to 'm_demand'.
+// it visits every cache, so it is done at most once a second
+void BufferPool::fold_demand(time_t now)
+{
+	if (now == m_last_fold)
+		return;
+
+	m_last_fold = now;
+	for (auto cache : m_thread_caches)
+	{
+		for (int i = 0; i < demand_buckets; ++i)
+		{
+			auto count{cache->m_demand[i].load(std::memory_order_relaxed)};
+			m_demand[i].fetch_add(count - cache->m_demand_folded[i], std::memory_order_relaxed);
+			cache->m_demand_folded[i] = count;
+		}
+	}
+}
+
+void BufferPool::set_max_slack(uint32_t percent)
+{
+	m_max_slack = percent;
+}
+
+void BufferPool::set_capacity(size_t max_bytes, size_t max_class_buffers)
+{
+	{
+		auto buffers_lock{lock_buffers()};
+		m_capacity_bytes = max_bytes;
+		m_capacity_class_buffers = max_class_buffers;
+		// a lowered limit applies to the free buffers already held
+		if (max_bytes && m_pooled_bytes > max_bytes)
+			reclaim(clock_now(), SIZE_MAX, max_bytes);
+	}
+
+	// the limits may have been raised
+	if (m_capacity_demand.load(std::memory_order_relaxed))
+		capacity_released();
+}
+
+bool BufferPool::make_room(uint32_t allocated, int32_t bin)
+{
+	// a class that is full has no free buffers either, or this would not have
+	// been reached
+	if (m_capacity_class_buffers && bin >= 0 && m_bins[bin].m_count >= m_capacity_class_buffers)
+		return false;
+
+	if (!m_capacity_bytes || m_pooled_bytes + allocated <= m_capacity_bytes)
+		return true;
+	if (allocated > m_capacity_bytes)
+		return false;
+
+	// drop the least recently used free buffers, however young, until the new
+	// one fits
+	reclaim(clock_now(), SIZE_MAX, m_capacity_bytes - allocated);
+	return m_pooled_bytes + allocated <= m_capacity_bytes;
+}
+
+bool BufferPool::make_room(size_t bytes, const std::vector<size_t>& class_counts)
+{
+	// free buffers in a class count against its limit too; they are not
+	// dropped to let others in
+	if (m_capacity_class_buffers)
+	{
+		for (size_t i = 0; i < class_counts.size(); ++i)
+		{
+			if (class_counts[i] && m_bins[i].m_count + class_counts[i] > m_capacity_class_buffers)
+				return false;
+		}
+	}
+
+	if (!m_capacity_bytes || m_pooled_bytes + bytes <= m_capacity_bytes)
+		return true;
+	if (bytes > m_capacity_bytes)
+		return false;
+
+	reclaim(clock_now(), SIZE_MAX, m_capacity_bytes - bytes);
+	return m_pooled_bytes + bytes <= m_capacity_bytes;
+}
+
+void BufferPool::capacity_released()
+{
+	std::vector<PendingAcquisition> served;
+	std::vector<BufferPtr> buffers;
+	{
+		const uint32_t node{acquire_node()};
+		auto buffers_lock{lock_buffers()};
+
+		// queued requests are served in order, so the first one that still
+		// cannot be satisfied holds up the rest
+		while (!m_pending_acquisitions.empty())
+		{
+			auto buffer{single_buffer_unprotected(m_pending_acquisitions.front().m_size, node)};
+			if (!buffer)
+				break;
+			buffers.push_back(std::move(buffer));
+			served.push_back(std::move(m_pending_acquisitions.front()));
+			m_pending_acquisitions.pop_front();
+			--m_capacity_demand;
+		}
+	}
+
+	// whatever room is left is for the waiters to contend for
+	m_capacity_freed.notify_all();
+
+	for (size_t i = 0; i < served.size(); ++i)
+	{
+		finish_acquire(buffers[i].get(), true);
+		served[i].m_callback(std::move(buffers[i]));
+	}
+}
+
+BufferPool::FragmentationStatistics BufferPool::fragmentation_statistics()
+{
+	FragmentationStatistics stats;
+	{
+		auto buffers_lock{lock_buffers()};
+		auto totals{usage_unprotected()};
+		stats.requested_bytes = totals.m_requested_bytes;
+		stats.allocated_bytes = totals.m_in_use_bytes;
+	}
+	stats.slack_misses = m_slack_misses.load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+BufferPool::PoolStatistics BufferPool::snapshot_stats()
+{
+	PoolStatistics stats;
+
+	// everything that is kept atomically
+	stats.global_hits = m_global_hits.load(std::memory_order_relaxed);
+	stats.misses = m_misses.load(std::memory_order_relaxed);
+	stats.slack_misses = m_slack_misses.load(std::memory_order_relaxed);
+	stats.spills = m_spills.load(std::memory_order_relaxed);
+	stats.refills = m_refills.load(std::memory_order_relaxed);
+	stats.gc_passes = m_gc_passes.load(std::memory_order_relaxed);
+	stats.gc_freed_buffers = m_gc_freed_buffers.load(std::memory_order_relaxed);
+	stats.gc_freed_bytes = m_gc_freed_bytes.load(std::memory_order_relaxed);
+	stats.gc_cold_buffers = m_gc_cold_buffers.load(std::memory_order_relaxed);
+	stats.gc_cold_bytes = m_gc_cold_bytes.load(std::memory_order_relaxed);
+	stats.gc_kept_buffers = m_gc_kept_buffers.load(std::memory_order_relaxed);
+	for (int i = 0; i < histogram_buckets; ++i)
+		stats.size_histogram[i] = m_size_histogram[i].load(std::memory_order_relaxed);
+
+	auto count{m_fixed_pool_count.load(std::memory_order_acquire)};
+	for (int i = 0; i < count; ++i)
+	{
+		auto& pool{*m_fixed_pools[i]};
+		stats.fixed_hits += pool.m_hits.load(std::memory_order_relaxed);
+		stats.bytes_allocated += static_cast<uint64_t>(pool.m_size) * pool.m_buffers.size();
+	}
+
+	// and what is guarded by the lock
+	auto buffers_lock{lock_buffers()};
+	stats.buffers_allocated = m_buffer_count + m_fixed_buffer_count;
+	stats.bytes_allocated += m_pooled_bytes;
+	auto totals{usage_unprotected()};
+	stats.buffers_in_use = static_cast<uint64_t>(totals.m_buffers);
+	stats.bytes_in_use = totals.m_in_use_bytes;
+	stats.bytes_requested = totals.m_requested_bytes;
+	stats.local_hits = m_retired_stats.local_hits;
+	stats.remote_releases = m_retired_stats.remote_releases;
+	stats.remote_drains = m_retired_stats.remote_drains;
+	for (auto cache : m_thread_caches)
+	{
+		ThreadStatistics thread;
+		thread.thread = cache->m_thread;
+		thread.local_hits = cache->m_local_hits.load(std::memory_order_relaxed);
+		thread.local_releases = cache->m_local_releases.load(std::memory_order_relaxed);
+		thread.remote_releases = cache->m_remote_releases.load(std::memory_order_relaxed);
+		thread.remote_drains = cache->m_remote_drains.load(std::memory_order_relaxed);
+		stats.local_hits += thread.local_hits;
+		stats.remote_releases += thread.remote_releases;
+		stats.remote_drains += thread.remote_drains;
+		for (int i = 0; i < histogram_buckets; ++i)
+			stats.size_histogram[i] += cache->m_size_histogram[i].load(std::memory_order_relaxed);
+		stats.threads.push_back(thread);
+	}
+	// read last, so that they include this acquisition
+	stats.lock_acquisitions = m_lock_acquisitions.load(std::memory_order_relaxed);
+	stats.lock_contentions = m_lock_contentions.load(std::memory_order_relaxed);
+	stats.lock_wait_ns = m_lock_wait_ns.load(std::memory_order_relaxed);
+	stats.lock_max_wait_ns = m_lock_max_wait_ns.load(std::memory_order_relaxed);
+	stats.lock_hold_ns = m_lock_hold_ns.load(std::memory_order_relaxed);
+	stats.lock_max_hold_ns = m_lock_max_hold_ns.load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+// the tagged overloads; with the 'Tracking' policy off, each costs only the
+// one test
+BufferPool::BufferPtr BufferPool::single_buffer(uint32_t min_size, const tracking_data_t& caller)
+{
+	auto buffer{single_buffer(min_size)};
+	if (m_policies[Policy::Tracking])
+		track_acquire(buffer.get(), caller);
+	return buffer;
+}
+
+void BufferPool::acquire_buffers(const std::vector<uint32_t>& sizes, std::vector<BufferPtr>& buffers, const tracking_data_t& caller)
+{
+	acquire_buffers(sizes, buffers);
+	if (m_policies[Policy::Tracking])
+	{
+		for (auto& buffer : buffers)
+			track_acquire(buffer.get(), caller);
+	}
+}
+
+BufferPool::BufferPtr BufferPool::single_buffer_from(const uint8_t* data, uint32_t size, const tracking_data_t& caller)
+{
+	auto buffer{single_buffer_from(data, size)};
+	if (m_policies[Policy::Tracking])
+		track_acquire(buffer.get(), caller);
+	return buffer;
+}
+
+BufferPool::BufferPtr BufferPool::single_buffer_from(const char* data, size_t size, const tracking_data_t& caller)
+{
+	auto buffer{single_buffer_from(data, size)};
+	if (m_policies[Policy::Tracking])
+		track_acquire(buffer.get(), caller);
+	return buffer;
+}
+
+BufferPool::BufferPtr BufferPool::single_buffer_from(const std::string& data, const tracking_data_t& caller)
+{
+	auto buffer{single_buffer_from(data)};
+	if (m_policies[Policy::Tracking])
+		track_acquire(buffer.get(), caller);
+	return buffer;
+}
+
+// every release clears the call site, so these only keep tagged calls compiling
+bool BufferPool::release_buffer(const BufferPtr& buffer, const tracking_data_t&)
+{
+	return release_buffer(buffer);
+}
+
+bool BufferPool::release_buffers(const std::vector<BufferPtr>& buffers, const tracking_data_t&)
+{
+	return release_buffers(buffers);
+}
+
+void BufferPool::track_acquire(Buffer* buffer, const tracking_data_t& caller)
+{
+	if (!caller.function)
+		return;
+
+	// the call site is only a few pointer stores; nothing is allocated, and no
+	// lock is needed
+	buffer->m_function.store(caller.function, std::memory_order_relaxed);
+	buffer->m_file.store(caller.file, std::memory_order_relaxed);
+	buffer->m_line.store(caller.line, std::memory_order_relaxed);
+
+	// only the holder writes a buffer's backtrace, so publishing it once is
+	// enough
+	auto backtrace{buffer->m_backtrace.load(std::memory_order_relaxed)};
+	auto rate{_tracking_sample_rate.load(std::memory_order_relaxed)};
+	if (rate && _tracking_sample_count.fetch_add(1, std::memory_order_relaxed) % rate == 0)
+	{
+		if (!backtrace)
+		{
+			backtrace = new Backtrace;
+			buffer->m_backtrace.store(backtrace, std::memory_order_release);
+		}
+		void* frames[tracking_frames];
+		auto count{capture_backtrace(frames, tracking_frames)};
+		for (int i = 0; i < count; ++i)
+			backtrace->m_frames[i].store(frames[i], std::memory_order_relaxed);
+		backtrace->m_count.store(count, std::memory_order_relaxed);
+	}
+	else if (backtrace)
+		backtrace->m_count.store(0, std::memory_order_relaxed);
+}
+
+void BufferPool::track_release(Buffer* buffer)
+{
+	// buffers may have been tracked before the policy was cleared, so this is
+	// done regardless of it
+	if (buffer->m_function.load(std::memory_order_relaxed))
+		buffer->m_function.store(nullptr, std::memory_order_relaxed);
+}
+
+void BufferPool::track_move(Buffer* from, Buffer* to)
+{
+	auto function{from->m_function.load(std::memory_order_relaxed)};
+	to->m_function.store(function, std::memory_order_relaxed);
+	if (!function)
+		return;
+
+	to->m_file.store(from->m_file.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	to->m_line.store(from->m_line.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+	auto source{from->m_backtrace.load(std::memory_order_relaxed)};
+	auto target{to->m_backtrace.load(std::memory_order_relaxed)};
+	auto count{source ? source->m_count.load(std::memory_order_relaxed) : 0};
+	if (count && !target)
+	{
+		target = new Backtrace;
+		to->m_backtrace.store(target, std::memory_order_release);
+	}
+	if (target)
+	{
+		for (int i = 0; i < count; ++i)
+			target->m_frames[i].store(source->m_frames[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		target->m_count.store(count, std::memory_order_relaxed);
+	}
+	from->m_function.store(nullptr, std::memory_order_relaxed);
+}
+
+void BufferPool::set_tracking_sample_rate(uint32_t one_in)
+{
+	_tracking_sample_rate.store(one_in, std::memory_order_relaxed);
+}
+
+void BufferPool::report_tracking()
+{
+	struct Entry
+	{
+		const char* function;
+		const char* file;
+		int line;
+		uint64_t bytes;
+		std::vector<void*> frames;
+	};
+	std::vector<Entry> entries;
+
+	auto collect = [&entries](const Buffer* buffer) {
+		auto function{buffer->m_function.load(std::memory_order_relaxed)};
+		if (!function)
+			return;
+		Entry entry{function, buffer->m_file.load(std::memory_order_relaxed), buffer->m_line.load(std::memory_order_relaxed), buffer->m_allocated, {}};
+		auto backtrace{buffer->m_backtrace.load(std::memory_order_acquire)};
+		auto count{backtrace ? std::min(backtrace->m_count.load(std::memory_order_relaxed), tracking_frames) : 0};
+		for (int i = 0; i < count; ++i)
+			entry.frames.push_back(backtrace->m_frames[i].load(std::memory_order_relaxed));
+		entries.push_back(std::move(entry));
+	};
+
+	// the lock keeps the registry (and each buffer's 'm_allocated') still; the
+	// report itself is written after it is released
+	{
+		auto buffers_lock{lock_buffers()};
+		for (const BufferPtr& buffer : m_buffers)
+		{
+			if (buffer)
+				collect(buffer.get());
+		}
+		auto count{m_fixed_pool_count.load(std::memory_order_acquire)};
+		for (int i = 0; i < count; ++i)
+		{
+			for (const BufferPtr& buffer : m_fixed_pools[i]->m_buffers)
+				collect(buffer.get());
+		}
+	}
+
+	struct Site
+	{
+		const char* function;
+		const char* file;
+		int line;
+		size_t buffers;
+		uint64_t bytes;
+	};
+	std::vector<Site> sites;
+	uint64_t total_bytes{0};
+	for (const auto& entry : entries)
+	{
+		total_bytes += entry.bytes;
+		auto site = std::find_if(sites.begin(), sites.end(), [&entry](const Site& site) {
+			return site.line == entry.line && strcmp(site.function, entry.function) == 0 &&
+				   strcmp(site.file ? site.file : "", entry.file ? entry.file : "") == 0;
+		});
+		if (site == sites.end())
+			sites.push_back(Site{entry.function, entry.file, entry.line, 1, entry.bytes});
+		else
+		{
+			++site->buffers;
+			site->bytes += entry.bytes;
+		}
+	}
+	std::sort(sites.begin(), sites.end(), [](const Site& a, const Site& b) {
+		return a.bytes > b.bytes;
+	});
+
+	std::cerr << "=== " << entries.size() << " tracked buffers in use (" << total_bytes << " bytes)" << std::endl;
+	for (const auto& site : sites)
+		std::cerr << "  " << site.buffers << " buffers, " << site.bytes << " bytes: " << site.function << " ("
+				  << (site.file ? site.file : "?") << ":" << site.line << ")" << std::endl;
+
+	for (const auto& entry : entries)
+	{
+		if (entry.frames.empty())
+			continue;
+		std::cerr << "--- " << entry.bytes << " bytes acquired by " << entry.function << " ("
+				  << (entry.file ? entry.file : "?") << ":" << entry.line << ")" << std::endl;
+#ifdef PERSISTENTBUFFER_EXECINFO
+		auto symbols{backtrace_symbols(entry.frames.data(), static_cast<int>(entry.frames.size()))};
+		for (size_t i = 0; i < entry.frames.size(); ++i)
+			std::cerr << "    " << (symbols ? symbols[i] : "?") << std::endl;
+		free(symbols);
+#else
+		for (auto frame : entry.frames)
+			std::cerr << "    " << frame << std::endl;
+#endif
+	}
+}
+
+void BufferPool::report_usage()
+{
+	// the thread caches' counts are summed under the lock, so this must not
+	// be called with it held
+	UsageTotals totals;
+	{
+		auto buffers_lock{lock_buffers()};
+		totals = usage_unprotected();
+	}
+	std::cerr << "<< " << totals.m_buffers << " buffers in use ("
+			  << totals.m_in_use_bytes << " bytes), "
+			  << m_global_hits.load(std::memory_order_relaxed) << " hits, "
+			  << m_misses.load(std::memory_order_relaxed) << " misses." << std::endl;
+}
+
+BufferPool::BuffersLock BufferPool::lock_buffers()
+{
+	// the clock is only read if the lock is contended
+	BuffersLock buffers_lock(m_buffers_lock, std::try_to_lock);
+	if (!buffers_lock.owns_lock())
+	{
+		auto start{steady_ns()};
+		buffers_lock.lock();
+		auto waited{steady_ns() - start};
+		bump(m_lock_contentions);
+		bump(m_lock_wait_ns, waited);
+		raise_to(m_lock_max_wait_ns, waited);
+
+		PERSISTENTBUFFER_PROBE2(lock__wait, m_id, waited);
+		trace(TraceEvent::LockWait, nullptr, 0, 0, 0, waited);
+	}
+	bump(m_lock_acquisitions);
+
+	return buffers_lock;
+}
+
+void BufferPool::lock_held(uint64_t held_ns)
+{
+	bump(m_lock_hold_ns, held_ns);
+	raise_to(m_lock_max_hold_ns, held_ns);
+
+	PERSISTENTBUFFER_PROBE2(lock__hold, m_id, held_ns);
+	trace(TraceEvent::LockHold, nullptr, 0, 0, 0, held_ns);
+}
+
+void BufferPool::set_trace_hook(TraceHook hook, void* context)
+{
+	m_trace_context = context;
+	m_trace_hook.store(hook, std::memory_order_release);
+}
+
+void BufferPool::trace(TraceEvent event, const Buffer* buffer, uint32_t size, uint32_t allocated, uint64_t count, uint64_t duration_ns)
+{
+	// the only cost on the hot paths when no hook is installed
+	auto hook{m_trace_hook.load(std::memory_order_acquire)};
+	if (!hook)
+		return;
+
+	TraceRecord record;
+	record.event = event;
+	record.timestamp_ns = steady_ns();
+	record.buffer = buffer;
+	record.size = size;
+	record.allocated = allocated;
+	record.count = count;
+	record.duration_ns = duration_ns;
+	hook(record, m_trace_context);
+}
+
+uint64_t BufferPool::gc_started()
+{
+	PERSISTENTBUFFER_PROBE1(gc__start, m_id);
+	if (!m_trace_hook.load(std::memory_order_relaxed))
+		return 0;
+
+	auto started{steady_ns()};
+	trace(TraceEvent::GcStart);
+	return started;
+}
+
+void BufferPool::gc_ended(uint64_t started, size_t handled)
+{
+	PERSISTENTBUFFER_PROBE2(gc__end, m_id, handled);
+	if (started)
+		trace(TraceEvent::GcEnd, nullptr, 0, 0, handled, steady_ns() - started);
+}
+
+void BufferPool::acquire_buffers(const std::vector<uint32_t>& sizes, std::vector<BufferPool::BufferPtr>& buffers)
+{
+	const bool use_cache{m_policies[Policy::ThreadCache]};
+	const bool use_fixed{m_fixed_pool_count.load(std::memory_order_relaxed) != 0};
+
+	buffers.clear();
+	buffers.resize(sizes.size());
+
+	// whatever the lock-free tiers can satisfy is taken first; the rest are
+	// collected in ascending size order
+	std::vector<size_t> order;
+	order.reserve(sizes.size());
+	bool capped{false};
+	bool drained{false};
+	for (size_t i = 0; i < sizes.size(); ++i)
+	{
+		if (use_fixed)
+			buffers[i] = fixed_pool_acquire(sizes[i]);
+		if (!buffers[i] && use_cache)
+		{
+			auto& cache{thread_cache()};
+			buffers[i] = thread_cache_take(cache, sizes[i]);
+			// on the first local miss, take in whatever other threads have
+			// handed back, and look again
+			if (!buffers[i] && !drained)
+			{
+				drained = true;
+				if (remote_drain(cache))
+					buffers[i] = thread_cache_take(cache, sizes[i]);
+			}
+		}
+		if (!buffers[i])
+			order.push_back(i);
+	}
+
+	// the drain may have taken this thread's cache over its capacity
+	if (drained && order.empty() && thread_cache().m_buffers.size() > m_thread_cache_capacity)
+	{
+		auto buffers_lock{lock_buffers()};
+		thread_cache_trim();
+	}
+
+	if (!order.empty())
+	{
+		std::stable_sort(order.begin(), order.end(), [&sizes](size_t a, size_t b) {
+			return sizes[a] < sizes[b];
+		});
+
+		const uint32_t node{acquire_node()};
+		auto buffers_lock{lock_buffers()};
+		if (drained)
+			thread_cache_trim();
+		size_t cursor{0};
+		for (auto i : order)
+		{
+			buffers[i] = single_buffer_unprotected(sizes[i], node, &cursor);
+			if (!buffers[i])
+			{
+				capped = true;
+				break;
+			}
+			// as with thread_cache_acquire(), the buffer is released to this thread's cache
+			if (use_cache)
+				buffers[i]->m_cached = true;
+		}
+	}
+
+	for (auto& buffer : buffers)
+	{
+		if (buffer)
+			finish_acquire(buffer.get(), true);
+	}
+	if (capped)
+	{
+		// the pool is at its capacity; the batch is all or nothing
+		release_buffers(buffers);
+		buffers.clear();
+		throw std::bad_alloc();
+	}
+	if (m_policies[Policy::UsageReport])
+		report_usage();
+}
+
+BufferPool::BufferPtr BufferPool::single_buffer(uint32_t min_size)
+{
+	auto buffer{acquire(min_size)};
+	if (m_policies[Policy::UsageReport])
+		report_usage();
+  return buffer;
+}
+
+BufferPool::BufferPtr BufferPool::try_single_buffer(uint32_t min_size)
+{
+	auto buffer{try_acquire(min_size)};
+	if (m_policies[Policy::UsageReport])
+		report_usage();
+	return buffer;
+}
+
+BufferPool::BufferPtr BufferPool::single_buffer_wait(uint32_t min_size, std::chrono::milliseconds timeout)
+{
+	auto buffer{try_acquire(min_size)};
+	if (!buffer && timeout.count() > 0)
+	{
+		auto deadline{std::chrono::steady_clock::now() + timeout};
+
+		// the demand is raised under the lock, so any release after this
+		// point will notify
+		const uint32_t node{acquire_node()};
+		auto buffers_lock{lock_buffers()};
+		++m_capacity_demand;
+		for (;;)
+		{
+			buffer = single_buffer_unprotected(min_size, node);
+			if (buffer)
+				break;
+			if (m_capacity_freed.wait_until(buffers_lock, deadline) == std::cv_status::timeout)
+			{
+				buffer = single_buffer_unprotected(min_size, node);
+				break;
+			}
+		}
+		--m_capacity_demand;
+		// as with thread_cache_acquire(), the buffer is released to this thread's cache
+		if (buffer && m_policies[Policy::ThreadCache])
+			buffer->m_cached = true;
+		buffers_lock.unlock();
+
+		if (buffer)
+			finish_acquire(buffer.get(), true);
+	}
+
+	if (m_policies[Policy::UsageReport])
+		report_usage();
+	return buffer;
+}
+
+void BufferPool::single_buffer_async(uint32_t min_size, AcquireCallback callback)
+{
+	auto buffer{try_acquire(min_size)};
+	if (!buffer)
+	{
+		const uint32_t node{acquire_node()};
+		auto buffers_lock{lock_buffers()};
+		// room may have been made since; if not, the request waits its turn
+		buffer = single_buffer_unprotected(min_size, node);
+		if (!buffer)
+		{
+			m_pending_acquisitions.push_back(PendingAcquisition{min_size, std::move(callback)});
+			++m_capacity_demand;
+			return;
+		}
+		buffers_lock.unlock();
+
+		finish_acquire(buffer.get(), true);
+	}
+
+	if (m_policies[Policy::UsageReport])
+		report_usage();
+	callback(std::move(buffer));
+}
+
+// get a buffer with the required 'size' holding the provided content
+BufferPool::BufferPtr BufferPool::single_buffer_from(const std::string& data)
+{
+	auto buffer{single_buffer_from(reinterpret_cast<const uint8_t*>(data.c_str()), static_cast<uint32_t>(data.length() + 1))};
+	if (m_policies[Policy::UsageReport])
+		report_usage();
+	return buffer;
+}
+
+BufferPool::BufferPtr BufferPool::single_buffer_from(const char* data, size_t size)
+{
+	auto buffer{single_buffer_from(reinterpret_cast<const uint8_t*>(data), static_cast<uint32_t>(size))};
+	if (m_policies[Policy::UsageReport])
+		report_usage();
+	return buffer;
+}
+
+BufferPool::BufferPtr BufferPool::single_buffer_from(const uint8_t* data, uint32_t size)
+{
+	// every byte handed out is about to be overwritten
+	auto buffer{acquire(size, false)};
+	auto p{buffer->rw()};
+	memcpy(p, data, size);
+	if (m_policies[Policy::UsageReport])
+		report_usage();
+	return buffer;
+}
+
+BufferPool::ScopedBuffer BufferPool::scoped_buffer(uint32_t min_size)
+{
+	auto buffer{acquire(min_size)};
+	auto p{buffer.get()};
+	// the owner holds a raw pointer; the pin keeps the buffer alive for it
+	p->m_pin = std::move(buffer);
+	return ScopedBuffer(p);
+}
+
+BufferPool::BufferHandle BufferPool::buffer_handle(uint32_t min_size)
+{
+	return BufferHandle(scoped_buffer(min_size));
+}
+
+BufferPool::BufferChain BufferPool::acquire_chain(const std::vector<uint32_t>& sizes)
+{
+	std::vector<BufferPtr> buffers;
+	acquire_buffers(sizes, buffers);
+
+	BufferChain chain;
+	chain.m_segments.reserve(buffers.size());
+#ifndef _WIN32
+	chain.m_iov.reserve(buffers.size());
+#endif
+	for (auto& buffer : buffers)
+		chain.append(std::move(buffer));
+	return chain;
+}
+
+void BufferPool::release_pinned(Buffer* buffer)
+{
+	// take the pin first: releasing may let the pool drop its own reference.
+	// a buffer made inert by reset() (or by its pool going away) is not
+	// returned to anything
+	BufferPtr pin{std::move(buffer->m_pin)};
+	if (pin->m_in_use)
+		pin->m_pool->release_buffer(pin);
+}
+
+bool BufferPool::resize_buffer(BufferPtr& buffer, uint32_t new_size)
+{
+	if (!buffer.get() || !buffer->m_in_use)
+		return false;
+
+	const uint32_t old_size{buffer->m_data_size};
+	const bool zero{m_policies[Policy::ZeroBuffer]};
+
+	// the storage already has room; only the size changes
+	if (new_size <= buffer->m_allocated)
+	{
+		if (zero && new_size > old_size)
+			zero_storage(buffer->m_buffer.get() + old_size, new_size - old_size);
+		// release zeroes only up to the data size, so the bytes a shrink
+		// gives up have to be cleared now
+		else if (zero && m_policies[Policy::ZeroOnRelease] && new_size < old_size)
+			zero_storage(buffer->m_buffer.get() + new_size, old_size - new_size);
+		count_in_use(buffer.get(), false);
+		buffer->m_data_size = new_size;
+		count_in_use(buffer.get(), true);
+		return true;
+	}
+
+	const bool shared{buffer->m_fixed_pool < 0 && !m_policies[Policy::ThreadCache]};
+
+	// storage with a slab to itself can be grown where it is
+	if (shared && buffer->m_slab)
+	{
+		auto buffers_lock{lock_buffers()};
+
+		auto bin{bin_index(new_size)};
+		uint32_t allocated{(bin >= 0) ? m_bins[bin].m_size : new_size};
+		// the growth counts against the capacity limits like a new buffer
+		// would, and a class it moves to gains a buffer
+		if (m_capacity_bytes || m_capacity_class_buffers)
+		{
+			if (!make_room(allocated - buffer->m_allocated, (bin != buffer->m_bin) ? bin : -1))
+				return false;
+		}
+		if (buffer->m_slab->remap(allocated))
+		{
+			if (buffer->m_bin < 0)
+			{
+				auto iter = std::lower_bound(m_size_list.begin(), m_size_list.end(), buffer->m_allocated, [](const BufferPtr& entry, uint32_t value) {
+					return entry->m_allocated < value;
+				});
+				while (iter->get() != buffer.get())
+					++iter;
+				m_size_list.erase(iter);
+			}
+
+			const uint32_t old_allocated{buffer->m_allocated};
+			count_in_use(buffer.get(), false);
+			m_pooled_bytes += allocated - old_allocated;
+			buffer->m_allocated = allocated;
+			if (buffer->m_bin >= 0)
+				--m_bins[buffer->m_bin].m_count;
+			if (bin >= 0)
+				++m_bins[bin].m_count;
+			buffer->m_bin = bin;
+			buffer->m_data_size = new_size;
+			// the slab may have moved; re-alias it
+			buffer->m_buffer = Buffer::DataPtr(buffer->m_buffer, buffer->m_slab->m_base);
+			count_in_use(buffer.get(), true);
+
+			if (bin < 0)
+			{
+				auto position = std::upper_bound(m_size_list.begin(), m_size_list.end(), allocated, [](uint32_t value, const BufferPtr& entry) {
+					return value < entry->m_allocated;
+				});
+				m_size_list.insert(position, buffer);
+			}
+			buffers_lock.unlock();
+			// a class the buffer left may have room for a waiter now
+			if (m_capacity_demand.load(std::memory_order_relaxed))
+				capacity_released();
+
+			// pages the mapping gained are zero-filled already
+			if (zero)
+				zero_storage(buffer->m_buffer.get() + old_size, old_allocated - old_size);
+			return true;
+		}
+	}
+
+	BufferPtr replacement;
+	if (shared)
+	{
+		// acquire, copy and release under the one lock
+		const uint32_t node{acquire_node()};
+		auto buffers_lock{lock_buffers()};
+		replacement = single_buffer_unprotected(new_size, node);
+		if (!replacement)
+			return false;
+		memcpy(replacement->m_buffer.get(), buffer->m_buffer.get(), old_size);
+		track_move(buffer.get(), replacement.get());
+		count_in_use(buffer.get(), false);
+		release_unprotected(buffer, clock_now());
+		buffers_lock.unlock();
+		// the old buffer may be what a waiter needs
+		if (m_capacity_demand.load(std::memory_order_relaxed))
+			capacity_released();
+
+		finish_acquire(replacement.get(), false);
+	}
+	else
+	{
+		// the other tiers are not behind the lock to begin with
+		replacement = try_acquire(new_size, false);
+		if (!replacement)
+			return false;
+		memcpy(replacement->m_buffer.get(), buffer->m_buffer.get(), old_size);
+		track_move(buffer.get(), replacement.get());
+		release_buffer(buffer);
+	}
+
+	if (zero)
+		zero_storage(replacement->m_buffer.get() + old_size, new_size - old_size);
+
+	buffer = std::move(replacement);
+	return true;
+}
+
+bool BufferPool::buffer_in_use(const BufferPool::BufferPtr& buffer)
+{
+	auto buffers_lock{lock_buffers()};
+	return buffer.get() && buffer->m_in_use;
+}
+
+void BufferPool::garbage_collect(time_t start_time)
+{
+	bump(m_gc_passes);
+	auto started{gc_started()};
+	gc_ended(started, reclaim(start_time, SIZE_MAX, SIZE_MAX));
+}
+
+size_t BufferPool::reclaim(time_t now, size_t limit, size_t target_bytes)
+{
+	const bool timed{m_policies[Policy::DropOld] && m_cleanup_timeout};
+	const bool soft{timed && m_policies[Policy::SoftRelease]};
+	const bool adaptive{timed && m_policies[Policy::AdaptiveSizing]};
+	bool exact_dropped{false};
+	size_t dropped{0};
+	size_t cooled{0};
+	size_t kept{0};
+
+	// with 'AdaptiveSizing', each sixteenth of recent requests that a size
+	// could serve earns it one idle buffer per pass; these count the buffers
+	// kept so far in this pass, by histogram step
+	uint64_t total_demand{0};
+	std::array<uint32_t, demand_buckets> kept_by_step{};
+	if (adaptive)
+	{
+		decay_demand(now);
+		for (const auto& count : m_demand)
+			total_demand += count.load(std::memory_order_relaxed);
+	}
+
+	// the age list is ordered oldest first, so only buffers that have to go are
+	// visited
+	while (m_oldest && dropped + cooled + kept < limit &&
+		   (m_pooled_bytes > target_bytes || (timed && (now - m_oldest->m_last_used) > m_cleanup_timeout)))
+	{
+		BufferPtr buffer{m_buffers[m_oldest->m_slot]}; // drop this one, it's too old
+		age_remove(buffer.get());
+
+		// a buffer that has only expired is kept, as if just released, while
+		// its size is still in demand
+		if (total_demand && m_pooled_bytes <= target_bytes)
+		{
+			auto step{demand_bucket(buffer->m_allocated)};
+			if (kept_by_step[step] < served_demand(buffer.get()) * _popular_share / total_demand)
+			{
+				++kept_by_step[step];
+				buffer->m_last_used = now;
+				age_push(buffer.get());
+				++kept;
+				continue;
+			}
+		}
+
+		// a buffer that has only expired is made cold, and goes to the back of
+		// the list to expire again.  nothing in a pool file is released this way
+		if (soft && !buffer->m_cold && !buffer->m_record && m_pooled_bytes <= target_bytes)
+		{
+			auto released{release_pages(buffer->m_buffer.get(), buffer->m_allocated)};
+			if (released)
+			{
+				buffer->m_cold = true;
+				buffer->m_last_used = now;
+				age_push(buffer.get());
+				bump(m_gc_cold_bytes, released);
+				++cooled;
+				continue;
+			}
+		}
+
+		if (buffer->m_bin >= 0)
+			bin_remove(buffer.get());
+		else
+			exact_dropped = true;
+		bump(m_gc_freed_bytes, buffer->m_allocated);
+		unregister_buffer(buffer);
+		++dropped;
+	}
+
+	bump(m_gc_freed_buffers, dropped);
+	bump(m_gc_cold_buffers, cooled);
+	bump(m_gc_kept_buffers, kept);
+
+	// dropped exact-size buffers are no longer registered; take them all out
+	// of the size list in a single compaction pass
+	if (exact_dropped)
+	{
+		m_size_list.erase(std::remove_if(m_size_list.begin(), m_size_list.end(), [](const BufferPtr& buffer) {
+			return buffer->m_slot == _no_slot;
+		}), m_size_list.end());
+	}
+
+	return dropped + cooled + kept;
+}
+
+void BufferPool::start_reclaimer(uint32_t interval_ms, size_t high_watermark, size_t batch_size)
+{
+	stop_reclaimer();
+
+	{
+		auto buffers_lock{lock_buffers()};
+		m_high_watermark = high_watermark;
+		m_reclaimer_running = true;
+	}
+
+	std::unique_lock<std::mutex> reclaimer_lock(m_reclaimer->m_lock);
+	m_reclaimer->m_stop = false;
+	m_reclaimer->m_triggered = false;
+	m_reclaimer->m_interval = std::chrono::milliseconds(std::max<uint32_t>(interval_ms, 1));
+	m_reclaimer->m_batch_size = std::max<size_t>(batch_size, 1);
+	if (m_reclaimer->m_resolution.count())
+		m_reclaimer->m_coarse_now.store(time(nullptr), std::memory_order_relaxed);
+	m_reclaimer->m_thread = std::thread(&BufferPool::reclaimer_main, this);
+}
+
+void BufferPool::stop_reclaimer()
+{
+	std::thread thread;
+	{
+		std::unique_lock<std::mutex> reclaimer_lock(m_reclaimer->m_lock);
+		if (!m_reclaimer->m_thread.joinable())
+			return;
+		m_reclaimer->m_stop = true;
+		m_reclaimer->m_coarse_now.store(0, std::memory_order_relaxed);
+		thread = std::move(m_reclaimer->m_thread);
+	}
+	m_reclaimer->m_wake.notify_all();
+	thread.join();
+
+	{
+		auto buffers_lock{lock_buffers()};
+		m_reclaimer_running = false;
+		m_high_watermark = 0;
+	}
+
+	// finish anything the thread had not got to
+	scrub_pending(SIZE_MAX);
+	if (m_capacity_demand.load(std::memory_order_relaxed))
+		capacity_released();
+}
+
+void BufferPool::wake_reclaimer()
+{
+	{
+		std::unique_lock<std::mutex> reclaimer_lock(m_reclaimer->m_lock);
+		m_reclaimer->m_triggered = true;
+	}
+	m_reclaimer->m_wake.notify_one();
+}
+
+void BufferPool::scrub_pending(size_t batch_size)
+{
+	// the storage and its extent are captured under the lock, so a reset()
+	// while we are zeroing cannot pull them out from under us
+	struct Pending
+	{
+		BufferPtr m_buffer;
+		Buffer::DataPtr m_storage;
+		uint32_t m_bytes;
+	};
+	std::vector<Pending> batch;
+
+	for (;;)
+	{
+		{
+			auto buffers_lock{lock_buffers()};
+			auto count{std::min(batch_size, m_scrub_list.size())};
+			if (!count)
+				return;
+			for (auto iter = m_scrub_list.end() - count; iter != m_scrub_list.end(); ++iter)
+				batch.push_back({*iter, (*iter)->m_buffer, (*iter)->m_data_size});
+			m_scrub_list.resize(m_scrub_list.size() - count);
+		}
+
+		for (auto& entry : batch)
+			zero_storage(entry.m_storage.get(), entry.m_bytes);
+
+		auto buffers_lock{lock_buffers()};
+		auto now{clock_now()};
+		for (auto& entry : batch)
+		{
+			auto buffer{entry.m_buffer.get()};
+			// cleared if the pool was reset in the meantime
+			if (!buffer->m_scrubbing)
+				continue;
+
+			buffer->m_scrubbing = false;
+			buffer->m_zeroed = true;
+			// restamped, as in thread_cache_spill(), to keep the age list ordered
+			buffer->m_last_used = now;
+			if (buffer->m_bin >= 0)
+				bin_push(buffer);
+			age_push(buffer);
+		}
+		batch.clear();
+	}
+}
+
+void BufferPool::set_clock_resolution(uint32_t seconds)
+{
+	{
+		std::unique_lock<std::mutex> reclaimer_lock(m_reclaimer->m_lock);
+		m_reclaimer->m_resolution = std::chrono::seconds(seconds);
+		auto now{(seconds && m_reclaimer->m_thread.joinable()) ? time(nullptr) : 0};
+		m_reclaimer->m_coarse_now.store(now, std::memory_order_relaxed);
+	}
+	// let the thread pick up its new wake-up interval
+	m_reclaimer->m_wake.notify_all();
+}
+
+time_t BufferPool::clock_now()
+{
+	auto now{m_reclaimer->m_coarse_now.load(std::memory_order_relaxed)};
+	return now ? now : time(nullptr);
+}
+
+size_t BufferPool::buffers_available()
+{
+	// the reclaimer thread may be changing the count
+	auto buffers_lock{lock_buffers()};
+	return m_buffer_count + m_fixed_buffer_count;
+}
+
+size_t BufferPool::bytes_pooled()
+{
+	auto buffers_lock{lock_buffers()};
+	return m_pooled_bytes;
+}
+
+void BufferPool::reclaimer_main()
+{
+	using clock = std::chrono::steady_clock;
+
+	std::unique_lock<std::mutex> reclaimer_lock(m_reclaimer->m_lock);
+	auto next_pass{clock::now() + m_reclaimer->m_interval};
+	while (!m_reclaimer->m_stop)
+	{
+		// wake for the next pass, or sooner if the coarse clock is due first
+		auto wake{next_pass};
+		if (m_reclaimer->m_resolution.count())
+			wake = std::min(wake, clock::now() + m_reclaimer->m_resolution);
+		m_reclaimer->m_wake.wait_until(reclaimer_lock, wake, [this] {
+			return m_reclaimer->m_stop || m_reclaimer->m_triggered;
+		});
+		if (m_reclaimer->m_stop)
+			break;
+
+		if (m_reclaimer->m_resolution.count())
+			m_reclaimer->m_coarse_now.store(time(nullptr), std::memory_order_relaxed);
+		if (!m_reclaimer->m_triggered && clock::now() < next_pass)
+			continue;
+
+		m_reclaimer->m_triggered = false;
+		next_pass = clock::now() + m_reclaimer->m_interval;
+		auto batch_size{m_reclaimer->m_batch_size};
+		reclaimer_lock.unlock();
+
+		scrub_pending(batch_size);
+
+		// the target is fixed for the whole pass so that, once over the high
+		// watermark, the pool is brought all the way down to the low one
+		size_t target_bytes{SIZE_MAX};
+		uint64_t started{0};
+		size_t handled{0};
+		for (bool first = true;; first = false)
+		{
+			auto buffers_lock{lock_buffers()};
+			if (first)
+			{
+				bump(m_gc_passes);
+				started = gc_started();
+				if (m_high_watermark && m_pooled_bytes > m_high_watermark)
+					target_bytes = m_high_watermark - m_high_watermark / 8;
+			}
+
+			auto now{time(nullptr)};
+			m_last_cleanup_check = now;
+			auto batch{reclaim(now, batch_size, target_bytes)};
+			handled += batch;
+			if (batch < batch_size)
+			{
+				gc_ended(started, handled);
+				break;
+			}
+			// let any waiting threads in between batches
+		}
+
+		// finished scrubs and dropped buffers may both have made room
+		if (m_capacity_demand.load(std::memory_order_relaxed))
+			capacity_released();
+
+		reclaimer_lock.lock();
+	}
+}
+
+BufferPool::BufferPtr BufferPool::single_buffer_unprotected(uint32_t min_size, uint32_t node, size_t* cursor, int32_t bin)
+{
+	assert(m_initialized);
+
+	const bool numa{m_policies[Policy::NumaAware]};
+
+	// requests that fall within a size class are served from that class's
+	// free list; in-use buffers are never on it, so there is nothing to skip
+	if (bin == unknown_bin)
+		bin = bin_index(min_size);
+	if (bin >= 0 && m_bins[bin].m_free_count)
+	{
+		BufferPtr buffer{bin_pop(m_bins[bin], node)};
+		age_remove(buffer.get());
+		buffer->m_in_use = true;
+		buffer->m_data_size = min_size;
+		++buffer->m_usage_count;
+		bump(m_global_hits);
+		return buffer;
+	}
+
+	// see if any existing free buffers match our 'min_size' requirement.
+	// everything between the lower bound and 'cursor' was found not to be
+	// free by an earlier request in the batch, and is still taken
+
+	auto first{m_size_list.begin()};
+	if (cursor)
+		first += std::min(*cursor, m_size_list.size());
+	auto iter = (bin >= 0) ? m_size_list.end()
+						   : std::lower_bound(first, m_size_list.end(), min_size, [](const BufferPtr& buffer, uint32_t value) {
+								 return buffer.get()->m_allocated < value;
+							 });
+
+	auto is_free = [](const BufferPtr& buffer) {
+		return !buffer->m_cached && !buffer->m_in_use && !buffer->m_scrubbing;
+	};
+	iter = std::find_if(iter, m_size_list.end(), is_free);
+	const uint32_t limit{slack_limit(min_size)};
+	if (cursor && bin < 0)
+		*cursor = static_cast<size_t>(iter - m_size_list.begin());
+
+	// prefer a buffer on the caller's node over a closer fit on another, if
+	// it is no more than twice that size and within the slack limit; the
+	// search stops there, rather than walking every larger buffer in the pool
+	if (numa && iter != m_size_list.end() && (*iter)->m_node != node)
+	{
+		const uint64_t bound{std::min<uint64_t>(static_cast<uint64_t>((*iter)->m_allocated) * 2, limit)};
+		auto last = std::upper_bound(iter, m_size_list.end(), bound, [](uint64_t value, const BufferPtr& buffer) {
+			return value < buffer->m_allocated;
+		});
+		auto local = std::find_if(iter, last, [&is_free, node](const BufferPtr& buffer) {
+			return buffer->m_node == node && is_free(buffer);
+		});
+		if (local != last)
+			iter = local;
+	}
+
+	// the closest fit is too big; leave it for a request that needs it
+	if (iter != m_size_list.end() && (*iter)->m_allocated > limit)
+	{
+		iter = m_size_list.end();
+		bump(m_slack_misses);
+	}
+
+	if (iter != m_size_list.end())
+	{
+		BufferPtr buffer = *iter;
+		assert(buffer->m_allocated >= min_size);
+		age_remove(buffer.get());
+		buffer->m_in_use = true;
+		buffer->m_data_size = min_size;
+		++buffer->m_usage_count;
+		bump(m_global_hits);
+
+		// 'ZeroBuffer' is honored by acquire(), once the lock is released
+		return buffer;
+	}
+
+	// a buffer still waiting for the reclaimer is better than a new one;
+	// acquire() will see that it has not been zeroed and do it itself
+	auto pending = std::find_if(m_scrub_list.rbegin(), m_scrub_list.rend(), [bin, min_size, limit](const BufferPtr& buffer) {
+		return (bin >= 0) ? (buffer->m_bin == bin) : (buffer->m_bin < 0 && buffer->m_allocated >= min_size && buffer->m_allocated <= limit);
+	});
+	if (pending != m_scrub_list.rend())
+	{
+		BufferPtr buffer{std::move(*pending)};
+		*pending = std::move(m_scrub_list.back());
+		m_scrub_list.pop_back();
+
+		buffer->m_scrubbing = false;
+		buffer->m_in_use = true;
+		buffer->m_data_size = min_size;
+		++buffer->m_usage_count;
+		bump(m_global_hits);
+		return buffer;
+	}
+
+	// if we reach here, there are no free buffers, or there are none that match 'min_size'
+	uint32_t allocated{(bin >= 0) ? m_bins[bin].m_size : min_size};
+	if (bin < 0 && m_policies[Policy::AdaptiveSizing])
+		allocated = adaptive_size(min_size);
+	if (m_capacity_bytes || m_capacity_class_buffers)
+	{
+		if (!make_room(allocated, bin))
+			return BufferPtr();
+		// dropping buffers may have compacted the size list under the cursor
+		if (cursor)
+			*cursor = 0;
+	}
+
+	BufferPtr buffer = std::make_shared<Buffer>();
+	bump(m_misses);
+	PERSISTENTBUFFER_PROBE4(miss, m_id, buffer.get(), min_size, allocated);
+	trace(TraceEvent::Miss, buffer.get(), min_size, allocated);
+	buffer->m_pool = this;
+	buffer->m_in_use = true;
+	++buffer->m_usage_count;
+	buffer->m_bin = bin;
+	buffer->m_allocated = allocated;
+	buffer->m_data_size = min_size;
+	buffer->m_node = static_cast<uint8_t>(node);
+	bool zeroed{false};
+	buffer->m_buffer = allocate_storage(buffer->m_allocated, numa ? static_cast<int32_t>(node) : -1, zeroed, &buffer->m_slab);
+	// invoking memset() here doesn't appear to have a noticible impact on performance
+	if (m_policies[Policy::ZeroBuffer] && !zeroed)
+		memset(buffer->rw(), 0, buffer->m_allocated);
+	buffer->m_zeroed = zeroed || m_policies[Policy::ZeroBuffer];
+
+	register_buffer(buffer);
+
+	// buffers in a size class are found through its free list, so only exact-size
+	// buffers need to be indexed.  the list is already ordered, so a sorted insert
+	// keeps it that way without re-sorting everything on each miss
+	if (bin < 0)
+	{
+		auto position = std::upper_bound(m_size_list.begin(), m_size_list.end(), buffer->m_allocated, [](uint32_t value, const BufferPtr& buffer) {
+			return value < buffer->m_allocated;
+		});
+		m_size_list.insert(position, buffer);
+	}
+
+	// with a background reclaimer running, just let it know if we have gone
+	// over the high watermark; otherwise, do garbage collection, if indicated
+	if (m_reclaimer_running)
+	{
+		if (m_high_watermark && m_pooled_bytes > m_high_watermark)
+			wake_reclaimer();
+	}
+	else if (m_policies[Policy::DropOld] && m_cleanup_timeout)
+	{
+		time_t now = time(nullptr);
+		if ((now - m_last_cleanup_check) > m_cleanup_timeout)
+		{
+			m_last_cleanup_check = now;
+			garbage_collect(now);
+			// the size index has been compacted
+			if (cursor)
+				*cursor = 0;
+		}
+	}
+
+	return buffer;
+}
+
+bool BufferPool::release_buffer(const BufferPool::BufferPtr& buffer)
+{
+	if (buffer.get() && buffer->m_in_use)
+	{
+		assert(buffer->m_pool == this);
+		count_in_use(buffer.get(), false);
+		track_release(buffer.get());
+
+		auto now{clock_now()};
+		if (buffer->m_record)
+			update_record(buffer.get(), now);
+		zero_released(buffer);
+
+		// only buffers that were handed out by the thread-cache tier may be
+		// returned to it; anything else goes back through the shared pool
+		if (buffer->m_fixed_pool >= 0)
+			fixed_pool_release(buffer, now);
+		else if (m_policies[Policy::ThreadCache] && buffer->m_cached && !m_capacity_demand.load(std::memory_order_relaxed))
+		{
+			if (thread_cache_release(buffer, now))
+			{
+				auto buffers_lock{lock_buffers()};
+				thread_cache_trim();
+			}
+		}
+		else
+		{
+			// while anything waits on the capacity limits, cached buffers are
+			// returned where it can get at them.  the shared pool reads
+			// 'm_cached' under the lock, so it is only cleared under it
+			auto buffers_lock{lock_buffers()};
+			buffer->m_cached = false;
+			release_unprotected(buffer, now);
+		}
+		if (m_capacity_demand.load(std::memory_order_relaxed))
+			capacity_released();
+		if (m_policies[Policy::UsageReport])
+			report_usage();
+	}
+	return true;
+}
+
+bool BufferPool::release_buffers(const std::vector<BufferPool::BufferPtr>& buffers)
+{
+	// as in release_buffer(), the thread caches are bypassed while anything
+	// waits on the capacity limits
+	const bool use_cache{m_policies[Policy::ThreadCache] && !m_capacity_demand.load(std::memory_order_relaxed)};
+	bool trim_cache{false};
+	// the whole batch is stamped with a single clock read
+	const time_t now{clock_now()};
+
+	// creating this thread's cache takes the lock, so it is done before the
+	// batch can be holding it
+	if (use_cache)
+		thread_cache();
+
+	// zeroing on release is done before the lock is taken
+	if (m_policies[Policy::ZeroBuffer] && m_policies[Policy::ZeroOnRelease])
+	{
+		for (const BufferPtr& buffer : buffers)
+		{
+			if (buffer.get() && buffer->m_in_use)
+				zero_released(buffer);
+		}
+	}
+
+	// with the thread-cache tier active, the lock is only taken if something
+	// in the batch actually needs the shared pool
+	BuffersLock buffers_lock;
+	if (!use_cache)
+		buffers_lock = lock_buffers();
+
+	for (const BufferPtr& buffer : buffers)
+	{
+		if (buffer.get() && buffer->m_in_use)
+		{
+			assert(buffer->m_pool == this);
+			count_in_use(buffer.get(), false);
+			track_release(buffer.get());
+			if (buffer->m_record)
+				update_record(buffer.get(), now);
+			if (buffer->m_fixed_pool >= 0)
+				fixed_pool_release(buffer, now);
+			else if (use_cache && buffer->m_cached)
+				trim_cache = thread_cache_release(buffer, now);
+			else
+			{
+				if (!buffers_lock.owns_lock())
+					buffers_lock = lock_buffers();
+				buffer->m_cached = false;
+				release_unprotected(buffer, now);
+			}
+		}
+	}
+
+	if (trim_cache)
+	{
+		if (!buffers_lock.owns_lock())
+			buffers_lock = lock_buffers();
+		thread_cache_trim();
+	}
+	if (buffers_lock.owns_lock())
+		buffers_lock.unlock();
+	if (m_capacity_demand.load(std::memory_order_relaxed))
+		capacity_released();
+	if (m_policies[Policy::UsageReport])
+		report_usage();
+	return true;
+}
+
+void BufferPool::register_buffer(const BufferPtr& buffer)
+{
+	if (m_free_slots.empty())
+	{
+		buffer->m_slot = static_cast<uint32_t>(m_buffers.size());
+		m_buffers.push_back(buffer);
+	}
+	else
+	{
+		buffer->m_slot = m_free_slots.back();
+		m_free_slots.pop_back();
+		m_buffers[buffer->m_slot] = buffer;
+	}
+	++m_buffer_count;
+	m_pooled_bytes += buffer->m_allocated;
+	if (buffer->m_bin >= 0)
+		++m_bins[buffer->m_bin].m_count;
+
+	if (m_mapped_arena && !buffer->m_record && m_mapped_arena->contains(buffer->m_buffer.get()))
+		buffer->m_record = m_mapped_arena->add_record(buffer->m_buffer.get(), buffer->m_allocated);
+}
+
+void BufferPool::unregister_buffer(const BufferPtr& buffer)
+{
+	auto slot{buffer->m_slot};
+	assert(m_buffers[slot] == buffer);
+
+	buffer->m_slot = _no_slot;
+	m_free_slots.push_back(slot);
+	--m_buffer_count;
+	m_pooled_bytes -= buffer->m_allocated;
+	if (buffer->m_bin >= 0)
+		--m_bins[buffer->m_bin].m_count;
+	// last, as 'buffer' may refer to this very entry
+	m_buffers[slot].reset();
+}
+
+void BufferPool::release_unprotected(const BufferPtr& buffer, time_t now)
+{
+	buffer->m_in_use = false;
+	buffer->m_cold = false;
+	buffer->m_last_used = now;
+
+	// a buffer that zero_released() did not zero is left to the reclaimer, and
+	// kept where no acquisition can find it until that is done
+	if (m_policies[Policy::ZeroBuffer] && m_policies[Policy::ZeroOnRelease] && !buffer->m_zeroed)
+	{
+		if (m_reclaimer_running)
+		{
+			buffer->m_scrubbing = true;
+			m_scrub_list.push_back(buffer);
+			if (m_scrub_list.size() == 1)
+				wake_reclaimer();
+			return;
+		}
+
+		// the reclaimer stopped after the buffer was released
+		zero_storage(buffer->m_buffer.get(), buffer->m_data_size);
+		buffer->m_zeroed = true;
+	}
+
+	if (buffer->m_bin >= 0)
+		bin_push(buffer.get());
+	age_push(buffer.get());
+}
+
+void BufferPool::zero_released(const BufferPtr& buffer)
+{
+	if (!m_policies[Policy::ZeroBuffer] || !m_policies[Policy::ZeroOnRelease])
+		return;
+
+	bool shared{buffer->m_fixed_pool < 0 && !(m_policies[Policy::ThreadCache] && buffer->m_cached)};
+	if (shared && m_reclaimer_running)
+		return;
+
+	zero_storage(buffer->m_buffer.get(), buffer->m_data_size);
+	buffer->m_zeroed = true;
+}
+
+void BufferPool::age_push(Buffer* buffer)
+{
+	buffer->m_newer = nullptr;
+	buffer->m_older = m_newest;
+	if (m_newest)
+		m_newest->m_newer = buffer;
+	else
+		m_oldest = buffer;
+	m_newest = buffer;
+}
+
+void BufferPool::age_remove(Buffer* buffer)
+{
+	if (buffer->m_older)
+		buffer->m_older->m_newer = buffer->m_newer;
+	else
+		m_oldest = buffer->m_newer;
+	if (buffer->m_newer)
+		buffer->m_newer->m_older = buffer->m_older;
+	else
+		m_newest = buffer->m_older;
+	buffer->m_older = buffer->m_newer = nullptr;
+}
+
+//----------------------------------------------------------------------------
+// BufferPool lock-free fixed-size pools
+
+BufferPool::BufferPtr BufferPool::fixed_pool_acquire(uint32_t min_size)
+{
+	auto count{m_fixed_pool_count.load(std::memory_order_acquire)};
+	for (int i = 0; i < count; ++i)
+	{
+		auto& pool{*m_fixed_pools[i]};
+		if (pool.m_size != min_size)
+			continue;
+
+		auto buffer{pool.pop()};
+		if (!buffer)
+			return BufferPtr(); // exhausted; use the general path
+		pool.m_hits.fetch_add(1, std::memory_order_relaxed);
+
+		buffer->m_in_use = true;
+		buffer->m_data_size = min_size;
+		++buffer->m_usage_count;
+		return pool.m_buffers[buffer->m_fixed_slot];
+	}
+
+	return BufferPtr();
+}
+
+void BufferPool::fixed_pool_release(const BufferPtr& buffer, time_t now)
+{
+	buffer->m_in_use = false;
+	buffer->m_last_used = now;
+
+	m_fixed_pools[buffer->m_fixed_pool]->push(buffer->m_fixed_slot);
+}
+
+//----------------------------------------------------------------------------
+// BufferPool thread-cache tier
+
+BufferPool::LocalCache& BufferPool::thread_cache()
+{
+	// one cache for each pool this thread has used.  threads rarely use more
+	// than one or two, so the cache found last is tried first and the rest
+	// are searched
+	static thread_local std::vector<std::unique_ptr<LocalCache>> caches;
+	auto& last{last_thread_cache()};
+
+	if (!last || last->m_pool_id != m_id)
+	{
+		// caches whose pool has been destroyed are of no further use
+		caches.erase(std::remove_if(caches.begin(), caches.end(), [](const std::unique_ptr<LocalCache>& cache) {
+			return !cache->m_pool.load(std::memory_order_acquire);
+		}), caches.end());
+
+		auto iter = std::find_if(caches.begin(), caches.end(), [this](const std::unique_ptr<LocalCache>& cache) {
+			return cache->m_pool_id == m_id;
+		});
+		if (iter == caches.end())
+		{
+			caches.emplace_back(new LocalCache(*this));
+			iter = caches.end() - 1;
+		}
+		last = iter->get();
+	}
+	auto& cache{*last};
+
+	// a reset() has invalidated everything this thread was holding
+	if (cache.m_generation != m_generation)
+	{
+		cache.m_buffers.clear();
+		cache.m_generation = m_generation;
+	}
+
+	return cache;
+}
+
+BufferPool::LocalCache*& BufferPool::last_thread_cache()
+{
+	static thread_local LocalCache* last{nullptr};
+	return last;
+}
+
+BufferPool::BufferPtr BufferPool::thread_cache_acquire(uint32_t min_size, int32_t bin)
+{
+	auto& cache{thread_cache()};
+
+	// buffers other threads have handed back are taken in once their queue
+	// is half full, so that it seldom overflows, or when nothing else fits.
+	// the lock is only needed if that takes the cache over its capacity
+	auto& queue{*cache.m_remote};
+	bool drained{queue.m_count.load(std::memory_order_relaxed) >= m_thread_cache_capacity / 2 && remote_drain(cache)};
+	auto local{thread_cache_take(cache, min_size)};
+	if (!local && !drained && remote_drain(cache))
+	{
+		drained = true;
+		local = thread_cache_take(cache, min_size);
+	}
+	if (drained && cache.m_buffers.size() > m_thread_cache_capacity)
+	{
+		auto buffers_lock{lock_buffers()};
+		thread_cache_spill(cache, cache.m_buffers.size() / 2);
+	}
+	if (local)
+		return local;
+
+	// local miss: satisfy the request from the shared pool and, while we hold
+	// the lock, pull a batch of other free buffers that would also have fit.
+	// only buffers on this thread's node are worth keeping close
+	const uint32_t node{acquire_node()};
+	auto buffers_lock{lock_buffers()};
+	if (bin == unknown_bin)
+		bin = bin_index(min_size);
+	auto buffer{single_buffer_unprotected(min_size, node, nullptr, bin)};
+	if (!buffer)
+		return buffer;
+	// this buffer now belongs to the thread-cache tier (see thread_cache_release())
+	buffer->m_cached = true;
+
+	const size_t target{m_thread_cache_capacity / 2};
+	if (bin >= 0)
+	{
+		if (cache.m_buffers.size() < target && m_bins[bin].m_free[node])
+		{
+			while (cache.m_buffers.size() < target && m_bins[bin].m_free[node])
+			{
+				auto cached{bin_pop(m_bins[bin], node)};
+				age_remove(cached.get());
+				cached->m_cached = true;
+				cache.m_buffers.push_back(std::move(cached));
+			}
+			bump(m_refills);
+		}
+	}
+	else if (cache.m_buffers.size() < target)
+	{
+		auto iter = std::lower_bound(m_size_list.begin(), m_size_list.end(), min_size, [](const BufferPtr& buffer, uint32_t value) {
+			return buffer.get()->m_allocated < value;
+		});
+
+		// only buffers this request could itself have used are worth caching
+		const uint32_t limit{slack_limit(min_size)};
+		size_t refilled{0};
+		for (; iter != m_size_list.end() && (*iter)->m_allocated <= limit && cache.m_buffers.size() < target; ++iter)
+		{
+			if ((*iter)->m_cached || (*iter)->m_in_use || (*iter)->m_scrubbing || (*iter)->m_node != node)
+				continue;
+			age_remove(iter->get());
+			(*iter)->m_cached = true;
+			cache.m_buffers.push_back(*iter);
+			++refilled;
+		}
+
+		if (refilled)
+			bump(m_refills);
+	}
+
+	return buffer;
+}
+
+BufferPool::BufferPtr BufferPool::thread_cache_take(LocalCache& cache, uint32_t min_size)
+{
+	// the cache is small and bounded, so a best-fit scan is cheap
+	const uint32_t limit{slack_limit(min_size)};
+	auto best{cache.m_buffers.end()};
+	for (auto iter = cache.m_buffers.begin(); iter != cache.m_buffers.end(); ++iter)
+	{
+		if ((*iter)->m_allocated >= min_size && (*iter)->m_allocated <= limit &&
+			(best == cache.m_buffers.end() || (*iter)->m_allocated < (*best)->m_allocated))
+			best = iter;
+	}
+
+	if (best != cache.m_buffers.end())
+	{
+		BufferPtr buffer{std::move(*best)};
+		cache.m_buffers.erase(best);
+
+		buffer->m_in_use = true;
+		buffer->m_data_size = min_size;
+		++buffer->m_usage_count;
+
+		bump(cache.m_local_hits);
+		return buffer;
+	}
+
+	return BufferPtr();
+}
+
+// 'buffer' must have been handed out by the thread-cache tier.  'm_cached'
+// stays set while the owning thread holds it, so the shared pool never looks
+// at 'm_in_use' on buffers it does not own.  a buffer acquired on another
+// thread is handed back to it, so that buffers do not pile up in the caches
+// of threads that only release.  returns true if the calling thread's cache
+// has grown past its capacity.
+bool BufferPool::thread_cache_release(const BufferPtr& buffer, time_t now)
+{
+	auto& cache{thread_cache()};
+
+	buffer->m_in_use = false;
+	buffer->m_cold = false;
+	buffer->m_last_used = now;
+
+	auto owner{buffer->m_owner};
+	if (owner && owner != cache.m_remote && remote_push(*owner, buffer.get()))
+	{
+		bump(cache.m_remote_releases);
+		return false;
+	}
+
+	cache.m_buffers.push_back(buffer);
+	bump(cache.m_local_releases);
+
+	return cache.m_buffers.size() > m_thread_cache_capacity;
+}
+
+bool BufferPool::remote_push(RemoteQueue& queue, Buffer* buffer)
+{
+	// a queue that is not keeping up takes nothing more
+	if (queue.m_count.load(std::memory_order_relaxed) >= m_thread_cache_capacity)
+		return false;
+
+	// nor does one whose owner has gone.  that is seen by the same
+	// compare-exchange that pushes, so the owner cannot close the queue in
+	// between and leave the buffer behind
+	queue.m_count.fetch_add(1, std::memory_order_relaxed);
+	auto head{queue.m_head.load(std::memory_order_relaxed)};
+	do
+	{
+		if (head == RemoteQueue::closed())
+		{
+			queue.m_count.fetch_sub(1, std::memory_order_relaxed);
+			return false;
+		}
+		buffer->m_next_remote = head;
+	} while (!queue.m_head.compare_exchange_weak(head, buffer, std::memory_order_release, std::memory_order_relaxed));
+
+	return true;
+}
+
+size_t BufferPool::remote_drain(LocalCache& cache, bool close)
+{
+	auto& queue{*cache.m_remote};
+	if (!close && !queue.m_head.load(std::memory_order_relaxed))
+		return 0;
+
+	// the registry keeps every buffer in the queue alive, so each can be
+	// turned back into a reference of its own
+	auto buffer{queue.m_head.exchange(close ? RemoteQueue::closed() : nullptr, std::memory_order_acquire)};
+	if (!buffer)
+		return 0;
+	size_t drained{0};
+	while (buffer)
+	{
+		auto next{buffer->m_next_remote};
+		buffer->m_next_remote = nullptr;
+		cache.m_buffers.push_back(buffer->shared_from_this());
+		buffer = next;
+		++drained;
+	}
+
+	queue.m_count.fetch_sub(drained, std::memory_order_relaxed);
+	bump(cache.m_remote_drains);
+	return drained;
+}
+
+BufferPool::RemoteQueue* BufferPool::claim_remote_queue()
+{
+	// a queue is only created when every existing one has an owner.  a
+	// closed queue is empty, and nothing can be pushed onto it until it is
+	// opened here
+	for (auto& queue : m_remote_queues)
+	{
+		if (queue->m_head.load(std::memory_order_relaxed) == RemoteQueue::closed())
+		{
+			queue->m_head.store(nullptr, std::memory_order_relaxed);
+			return queue.get();
+		}
+	}
+
+	m_remote_queues.emplace_back(new RemoteQueue);
+	return m_remote_queues.back().get();
+}
+
+// spills half of an over-capacity cache; the caller must hold 'm_buffers_lock'
+void BufferPool::thread_cache_trim()
+{
+	auto& cache{thread_cache()};
+	if (cache.m_buffers.size() > m_thread_cache_capacity)
+		thread_cache_spill(cache, cache.m_buffers.size() / 2);
+}
+
+// returns the 'count' oldest buffers in 'cache' to the shared pool; the
+// caller must hold 'm_buffers_lock'
+void BufferPool::thread_cache_spill(LocalCache& cache, size_t count)
+{
+	count = std::min(count, cache.m_buffers.size());
+	if (!count)
+		return;
+
+	// buffers age from the moment they rejoin the shared pool; restamping
+	// them keeps the age list ordered
+	auto now{clock_now()};
+
+	auto last{cache.m_buffers.begin() + count};
+	for (auto iter = cache.m_buffers.begin(); iter != last; ++iter)
+	{
+		(*iter)->m_cached = false;
+		(*iter)->m_last_used = now;
+		if ((*iter)->m_bin >= 0)
+			bin_push(iter->get());
+		age_push(iter->get());
+	}
+	cache.m_buffers.erase(cache.m_buffers.begin(), last);
+
+	bump(m_spills);
+}
+
+//----------------------------------------------------------------------------
+// BufferPool size class engine
+
+// replaces the active size class layout; the caller must hold 'm_buffers_lock'
+void BufferPool::build_bins(std::vector<uint32_t> sizes)
+{
+	std::sort(sizes.begin(), sizes.end());
+	sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+	sizes.erase(std::remove(sizes.begin(), sizes.end(), 0u), sizes.end());
+
+	// any buffers from a previous layout are still usable through the
+	// exact-size path, so detach them and index them there rather than
+	// dropping them
+	m_size_list.clear();
+	for (const BufferPtr& buffer : m_buffers)
+	{
+		if (!buffer)
+			continue;
+		buffer->m_bin = -1;
+		buffer->m_prev_free = buffer->m_next_free = nullptr;
+		m_size_list.push_back(buffer);
+	}
+	std::sort(m_size_list.begin(), m_size_list.end(), [](const BufferPtr& a, const BufferPtr& b) {
+		return a->m_allocated < b->m_allocated;
+	});
+
+	m_bins.clear();
+	m_bins.resize(sizes.size());
+	for (size_t i = 0; i < sizes.size(); ++i)
+		m_bins[i].m_size = sizes[i];
+	m_layout_id.store(_next_layout_id.fetch_add(1, std::memory_order_relaxed), std::memory_order_release);
+}
+
+// classes are few (a few dozen at most), so a binary search over them is
+// effectively constant time regardless of how many buffers are pooled
+int32_t BufferPool::bin_index(uint32_t min_size)
+{
+	if (m_bins.empty() || min_size > m_bins.back().m_size)
+		return -1;
+
+	auto iter = std::lower_bound(m_bins.begin(), m_bins.end(), min_size, [](const Bin& bin, uint32_t value) {
+		return bin.m_size < value;
+	});
+	return static_cast<int32_t>(iter - m_bins.begin());
+}
+
+void BufferPool::bin_push(Buffer* buffer)
+{
+	auto& bin{m_bins[buffer->m_bin]};
+	auto& head{bin.m_free[buffer->m_node]};
+
+	buffer->m_prev_free = nullptr;
+	buffer->m_next_free = head;
+	if (head)
+		head->m_prev_free = buffer;
+	head = buffer;
+	++bin.m_free_count;
+}
+
+BufferPool::BufferPtr BufferPool::bin_pop(Bin& bin, uint32_t node)
+{
+	if (!bin.m_free[node])
+	{
+		// nothing local; a remote buffer is still better than a new one
+		for (node = 0; node < max_numa_nodes && !bin.m_free[node]; ++node)
+			;
+	}
+	auto& head{bin.m_free[node]};
+	auto buffer{head};
+	assert(buffer);
+
+	head = buffer->m_next_free;
+	if (head)
+		head->m_prev_free = nullptr;
+	buffer->m_next_free = nullptr;
+	--bin.m_free_count;
+
+	return buffer->shared_from_this();
+}
+
+void BufferPool::bin_remove(Buffer* buffer)
+{
+	auto& bin{m_bins[buffer->m_bin]};
+
+	if (buffer->m_prev_free)
+		buffer->m_prev_free->m_next_free = buffer->m_next_free;
+	else
+		bin.m_free[buffer->m_node] = buffer->m_next_free;
+	if (buffer->m_next_free)
+		buffer->m_next_free->m_prev_free = buffer->m_prev_free;
+	buffer->m_prev_free = buffer->m_next_free = nullptr;
+	--bin.m_free_count;
 }
@@ -10,31 +10,48 @@
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <atomic>
 #include <bitset>
+#include <array>
+#include <thread>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <condition_variable>
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
 
 #include <time.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 
 // clang-format off
 
-// 0 - Tracking off
-// 1 - Diagnostic output to stderr showing usage statics
-// 2 - Acquisition/release tracking by function/line to stderr, with on-demand acquisition state reporting
-// 3 - Enables both #1 & #2
-#define PERSISTENTBUFFER_TRACKING 0
-
-#if PERSISTENTBUFFER_TRACKING >= 2
+// Appending PERSISTENTBUFFER_TRACKING_DATA to the arguments of an acquisition
+// selects the overload that tags it with its call site, for report_tracking()
+// to show while the 'Tracking' policy is active:
+//
+//     auto buffer{PersistentBuffer::single_buffer(size PERSISTENTBUFFER_TRACKING_DATA)};
+//
+// Tracking is switched on and off at run time, and does not change the
+// library's interface.  Define PERSISTENTBUFFER_TRACKING_DATA as empty before
+// including this header to compile every tag out.
+#ifndef PERSISTENTBUFFER_TRACKING_DATA
 #ifdef _WIN32
-#define PERSISTENTBUFFER_TRACKING_DATA ,{__FUNCTION__, __LINE__}
+#define PERSISTENTBUFFER_TRACKING_DATA ,{__FUNCTION__, __FILE__, __LINE__}
 #else
-#define PERSISTENTBUFFER_TRACKING_DATA ,{__func__, __LINE__}
+#define PERSISTENTBUFFER_TRACKING_DATA ,{__func__, __FILE__, __LINE__}
 #endif
-#else
-#define PERSISTENTBUFFER_TRACKING_DATA
 #endif
 
 // clang-format on
 
-/// @class PersistentBuffer
+/// @class BufferPool
 /// @brief Management of persistent buffers
 ///
 /// This class will manage the allocation and usage of persistent
@@ -45,23 +62,73 @@
 /// re-use behavior can reduce both run-time heap fragmentation and
 /// allocations overhead.
 ///
-/// It is implemented as a Singleton for the following reasons:
-///     1. Persistent buffers don't need to be context-specific;
-///     2. Persistent buffers are available throughout the application
-///        space, so subsystems wishing to employ them needn't have
-///        an instance of the manager passed down to them through a
-///        long chain, unnecessarily cluttering argument lists.
-class PersistentBuffer
+/// Each pool has its own lock, size index, policies and garbage
+/// collection, so subsystems with very different size profiles can
+/// each be given a pool tuned for them, and do not contend with one
+/// another.  Buffers must be released to the pool they came from.  A
+/// pool that is destroyed makes any buffers still held from it inert,
+/// as reset() does.
+///
+/// Most applications need only the one pool; see PersistentBuffer.
+class BufferPool
 {
 public: // aliases and enums
 	enum Policy
 	{
 		ZeroBuffer = 0,		// zero-initialize buffers when they are placed into use
 		DropOld,			// perform periodic garbage collection in 'ExpandAsNeeded' mode
+		ThreadCache,		// satisfy acquisitions and releases from a per-thread free list first
+		Arena,				// carve buffer storage out of large, contiguous slabs
+		ZeroOnRelease,		// with 'ZeroBuffer', zero buffers as they are released rather than reused
+		NumaAware,			// keep free buffers per NUMA node, and prefer the caller's node
+		Tracking,			// record the call sites of tagged acquisitions (see report_tracking())
+		UsageReport,		// write usage counts to stderr on every acquisition and release
+		SoftRelease,		// with 'DropOld', return an expired buffer's pages to the OS before dropping it
+		AdaptiveSizing,		// size new buffers, and keep old ones, by the sizes recently requested
+		LockProfiling,		// time how long the pool lock is held (see snapshot_stats() and set_trace_hook())
 		TotalPolicies,
 	};
 
-	class Buffer
+	enum class BinLayout
+	{
+		None,		// no size classes; buffers are allocated at exactly the requested size
+		PowerOfTwo,	// a size class at every power of two
+		Geometric,	// size classes spaced by a constant ratio (jemalloc-style)
+	};
+
+	// where a buffer was acquired.  only the pointers are kept, so the strings
+	// must outlive the buffer (PERSISTENTBUFFER_TRACKING_DATA supplies literals).
+	// a value-initialized instance ('function' null) tracks nothing
+	struct tracking_data_t
+	{
+		const char* function;
+		const char* file;
+		int line;
+	};
+	// the most frames kept from a sampled acquisition's backtrace
+	static constexpr int tracking_frames{16};
+
+private: // nested types
+	// a region of 'Arena' storage; a buffer may hold one to itself
+	struct Slab;
+	// a pool file mapped with map_arena(), and the entry it keeps for each
+	// buffer carved from it
+	struct MappedArena;
+	struct MappedRecord;
+	// the queue through which other threads return buffers to the thread
+	// that acquired them ('ThreadCache' policy)
+	struct RemoteQueue;
+
+	// the backtrace of a sampled acquisition.  a buffer allocates one the first
+	// time it is sampled, and keeps it for re-use
+	struct Backtrace
+	{
+		std::atomic<int> m_count{0};
+		std::array<std::atomic<void*>, tracking_frames> m_frames{};
+	};
+
+public: // nested types
+	class Buffer : public std::enable_shared_from_this<Buffer>
 	{
 	public: // methods
 		uint8_t const * const ro() const; // pointer is const; data is const
@@ -72,20 +139,39 @@ public: // aliases and enums
 	private: // aliases and enums
 		using DataPtr = std::shared_ptr<uint8_t>;
 
+	public: // methods
+		~Buffer() { delete m_backtrace.load(std::memory_order_relaxed); }
+
 	private: // methods
 		void operator delete(void*) {}
 		void reset()
 		{
 			m_in_use = false;
+			m_cached = false;
+			m_bin = -1;
+			m_prev_free = m_next_free = nullptr;
+			m_older = m_newer = nullptr;
+			m_owner = nullptr;
+			m_next_remote = nullptr;
+			m_fixed_pool = -1;
 			m_data_size = 0;
 			m_allocated = 0;
 			m_buffer.reset();
 			m_last_used = 0;
+			m_zeroed = false;
+			m_scrubbing = false;
+			m_cold = false;
+			m_node = 0;
+			m_slab = nullptr;
+			m_record = nullptr;
+			m_function.store(nullptr, std::memory_order_relaxed);
 		}
 
 	private: // data members
 		// is this buffer currently in use?
 		bool m_in_use{false};
+		// is this buffer owned by the thread-cache tier (free or in use)?
+		bool m_cached{false};
 		// how many bytes of user data are in the buffer?
 		uint32_t m_data_size{0};
 		// what is the total allocated size of the buffer?
@@ -94,187 +180,1473 @@ public: // aliases and enums
 		uint32_t m_usage_count{0};
 		// when was this buffer last used?
 		time_t m_last_used{0};
+		// is the storage known to hold no previous user's data?
+		bool m_zeroed{false};
+		// has this free buffer been left for the reclaimer to zero?
+		bool m_scrubbing{false};
+		// have this free buffer's pages been returned to the OS ('SoftRelease')?
+		// cleared when it is next released
+		bool m_cold{false};
+		// NUMA node the storage was allocated for ('NumaAware'; zero otherwise)
+		uint8_t m_node{0};
+		// the slab this buffer's storage has to itself, if any ('Arena' mode);
+		// such storage can be grown in place
+		Slab* m_slab{nullptr};
+		// this buffer's entry in the file its storage was carved from, if any
+		// (see map_arena())
+		MappedRecord* m_record{nullptr};
 		// pointer to (sizeof(uint8_t) * m_size) data
 		DataPtr m_buffer;
+		// index of the size class this buffer belongs to (-1 if none)
+		int32_t m_bin{-1};
+		// intrusive links for the size class free list; only valid while the
+		// buffer is free and held by the shared pool
+		Buffer* m_prev_free{nullptr};
+		Buffer* m_next_free{nullptr};
+		// intrusive links for the age list; as above, only valid while free
+		// and held by the shared pool
+		Buffer* m_older{nullptr};
+		Buffer* m_newer{nullptr};
+		// the return queue of the thread that acquired this buffer through the
+		// thread-cache tier, and the link while it waits there to be drained
+		RemoteQueue* m_owner{nullptr};
+		Buffer* m_next_remote{nullptr};
+		// fixed-size pool this buffer belongs to (-1 if none), and its slot there
+		int32_t m_fixed_pool{-1};
+		uint32_t m_fixed_slot{0};
+		// the pool this buffer belongs to, and its slot in that pool's registry
+		BufferPool* m_pool{nullptr};
+		uint32_t m_slot{0xFFFFFFFF};
+		// outstanding BufferHandle references; kept beside the metadata so
+		// copying a handle touches nothing else
+		std::atomic<uint32_t> m_refs{0};
+		// keeps this buffer alive while handles to it exist, even if the pool
+		// drops it (e.g., reset()); cleared by the final release
+		std::shared_ptr<Buffer> m_pin;
+		// where the current holder acquired this buffer ('m_function' is null if
+		// it was not tracked), and the backtrace if that acquisition was sampled
+		// (a count of zero if not).  report_tracking() reads these while buffers
+		// come and go through the lock-free tiers, so they are atomics
+		std::atomic<const char*> m_function{nullptr};
+		std::atomic<const char*> m_file{nullptr};
+		std::atomic<int> m_line{0};
+		std::atomic<Backtrace*> m_backtrace{nullptr};
 
-		friend PersistentBuffer;
+		friend BufferPool;
 	};
 	using BufferPtr = std::shared_ptr<Buffer>;
 
-#if PERSISTENTBUFFER_TRACKING >= 2
-	using tracking_data_t = std::pair<std::string, int>;
+	/// @class ScopedBuffer
+	/// @brief Move-only owner of a pooled buffer
+	///
+	/// Releases its buffer back to its pool when it is
+	/// destroyed.  Moving it around costs nothing (no reference counts
+	/// are touched).
+	class ScopedBuffer
+	{
+	public: // methods
+		ScopedBuffer() = default;
+		ScopedBuffer(ScopedBuffer&& other) noexcept : m_buffer(other.m_buffer) { other.m_buffer = nullptr; }
+		ScopedBuffer& operator=(ScopedBuffer&& other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				m_buffer = other.m_buffer;
+				other.m_buffer = nullptr;
+			}
+			return *this;
+		}
+		ScopedBuffer(const ScopedBuffer&) = delete;
+		ScopedBuffer& operator=(const ScopedBuffer&) = delete;
+		~ScopedBuffer() { reset(); }
+
+		Buffer* get() const { return m_buffer; }
+		Buffer* operator->() const { return m_buffer; }
+		Buffer& operator*() const { return *m_buffer; }
+		explicit operator bool() const { return m_buffer != nullptr; }
+
+		// release the buffer back to the pool now
+		void reset();
+
+	private: // methods
+		explicit ScopedBuffer(Buffer* buffer) : m_buffer(buffer) {}
+
+	private: // data members
+		Buffer* m_buffer{nullptr};
+
+		friend BufferPool;
+	};
+
+	/// @class BufferHandle
+	/// @brief Intrusive, reference-counted handle to a pooled buffer
+	///
+	/// Copies share a single count stored in the Buffer itself; when the
+	/// last copy goes away, the buffer is released back to its pool.
+	/// Moving a handle touches no reference count.
+	class BufferHandle
+	{
+	public: // methods
+		BufferHandle() = default;
+		BufferHandle(const BufferHandle& other) : m_buffer(other.m_buffer)
+		{
+			if (m_buffer)
+				m_buffer->m_refs.fetch_add(1, std::memory_order_relaxed);
+		}
+		BufferHandle(BufferHandle&& other) noexcept : m_buffer(other.m_buffer) { other.m_buffer = nullptr; }
+		BufferHandle(ScopedBuffer&& scoped);
+		// takes over a buffer acquired as a BufferPtr; 'buffer' is left empty,
+		// and no other copy of it may be released
+		explicit BufferHandle(BufferPtr&& buffer);
+		BufferHandle& operator=(BufferHandle other) noexcept
+		{
+			std::swap(m_buffer, other.m_buffer);
+			return *this;
+		}
+		~BufferHandle() { reset(); }
+
+		Buffer* get() const { return m_buffer; }
+		Buffer* operator->() const { return m_buffer; }
+		Buffer& operator*() const { return *m_buffer; }
+		explicit operator bool() const { return m_buffer != nullptr; }
+
+		// drop this reference; the buffer is released if it was the last
+		void reset();
+
+	private: // methods
+		// adopts a buffer whose reference count has already been set
+		explicit BufferHandle(Buffer* buffer) : m_buffer(buffer) {}
+
+	private: // data members
+		Buffer* m_buffer{nullptr};
+
+		friend BufferPool;
+	};
+
+	/// @class BufferSlice
+	/// @brief A reference-counted view of part of a pooled buffer
+	///
+	/// A slice holds a BufferHandle to the buffer it views, so the buffer
+	/// stays checked out until the last slice of it (and the last handle)
+	/// is dropped, and is then released back to its pool.  Taking or
+	/// copying a slice touches only that reference count, so a large
+	/// buffer can be handed out in fragments without copying any of it.
+	class BufferSlice
+	{
+	public: // methods
+		BufferSlice() = default;
+		// a view of 'length' bytes at 'offset'; the view is clipped to the buffer
+		BufferSlice(BufferHandle handle, uint32_t offset, uint32_t length) : m_handle(std::move(handle))
+		{
+			auto size{m_handle ? m_handle->size() : 0};
+			assert(offset <= size && length <= size - offset);
+			m_offset = std::min(offset, size);
+			m_length = std::min(length, size - m_offset);
+		}
+		// a view of the whole buffer
+		explicit BufferSlice(BufferHandle handle) : m_handle(std::move(handle)), m_length(m_handle ? m_handle->size() : 0) {}
+
+		uint8_t const * ro() const { return m_handle->ro() + m_offset; }
+		uint8_t * rw() const { return m_handle->rw() + m_offset; }
+		uint32_t size() const { return m_length; }
+		// where the view starts in the buffer behind it
+		uint32_t offset() const { return m_offset; }
+		const BufferHandle& handle() const { return m_handle; }
+		explicit operator bool() const { return static_cast<bool>(m_handle); }
+
+		// a view of part of this one; 'offset' is relative to this view
+		BufferSlice slice(uint32_t offset, uint32_t length) const
+		{
+			assert(offset <= m_length && length <= m_length - offset);
+			offset = std::min(offset, m_length);
+			return BufferSlice(m_handle, m_offset + offset, std::min(length, m_length - offset));
+		}
+
+		// drop this view; the buffer is released if it was the last reference
+		void reset()
+		{
+			m_handle.reset();
+			m_offset = m_length = 0;
+		}
+
+	private: // data members
+		BufferHandle m_handle;
+		uint32_t m_offset{0};
+		uint32_t m_length{0};
+	};
+
+	/// @class BufferChain
+	/// @brief A sequence of pooled buffers, for scatter-gather I/O
+	///
+	/// Owns its segments, and releases them back to their pool in a single
+	/// batch when it is destroyed or reset().  On POSIX systems the chain is
+	/// kept as an array of 'struct iovec' as well, so it can be passed
+	/// straight to readv(), writev() or sendmsg().  Every segment must come
+	/// from the same pool, and must not be resized while it is in a chain.
+	class BufferChain
+	{
+	public: // methods
+		BufferChain() = default;
+		BufferChain(BufferChain&& other) noexcept { *this = std::move(other); }
+		BufferChain& operator=(BufferChain&& other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				std::swap(m_segments, other.m_segments);
+#ifndef _WIN32
+				std::swap(m_iov, other.m_iov);
 #endif
+				std::swap(m_bytes, other.m_bytes);
+			}
+			return *this;
+		}
+		BufferChain(const BufferChain&) = delete;
+		BufferChain& operator=(const BufferChain&) = delete;
+		~BufferChain() { reset(); }
+
+		// adds a buffer to the end of the chain, which takes over releasing it
+		void append(BufferPtr buffer);
+
+		bool empty() const { return m_segments.empty(); }
+		size_t segments() const { return m_segments.size(); }
+		const BufferPtr& segment(size_t index) const { return m_segments[index]; }
+		const std::vector<BufferPtr>& buffers() const { return m_segments; }
+		// the combined size of every segment
+		size_t bytes() const { return m_bytes; }
+
+#ifndef _WIN32
+		const struct iovec* iov() const { return m_iov.data(); }
+		int iovcnt() const { return static_cast<int>(m_iov.size()); }
+#endif
+
+		// release every segment back to the pool now, in one batch
+		void reset();
+
+	private: // data members
+		std::vector<BufferPtr> m_segments;
+#ifndef _WIN32
+		std::vector<struct iovec> m_iov;
+#endif
+		size_t m_bytes{0};
+
+		friend BufferPool;
+	};
+
+	struct CacheStatistics
+	{
+		// acquisitions satisfied from the calling thread's local cache
+		uint64_t local_hits{0};
+		// acquisitions satisfied by re-using a buffer from the shared pool
+		uint64_t global_hits{0};
+		// acquisitions that required a fresh heap allocation
+		uint64_t misses{0};
+		// number of batched returns from thread caches to the shared pool
+		uint64_t spills{0};
+		// number of batched transfers from the shared pool to thread caches
+		uint64_t refills{0};
+		// releases handed back to the thread that acquired the buffer, and the
+		// batches in which those threads took them in
+		uint64_t remote_releases{0};
+		uint64_t remote_drains{0};
+	};
+
+	struct FragmentationStatistics
+	{
+		// bytes asked for by the holders of every buffer currently in use
+		uint64_t requested_bytes{0};
+		// bytes allocated to those buffers; the difference is internal fragmentation
+		uint64_t allocated_bytes{0};
+		// acquisitions that allocated because every free buffer that would have
+		// fit was more oversized than set_max_slack() allows
+		uint64_t slack_misses{0};
+	};
+
+	// the number of entries in 'PoolStatistics::size_histogram'
+	static constexpr int histogram_buckets{33};
+
+	struct ThreadStatistics
+	{
+		std::thread::id thread;
+		// acquisitions this thread satisfied from its own cache
+		uint64_t local_hits{0};
+		// releases this thread kept in its own cache
+		uint64_t local_releases{0};
+		// releases this thread handed back to the thread that acquired the
+		// buffer, and the batches of such buffers it took in itself
+		uint64_t remote_releases{0};
+		uint64_t remote_drains{0};
+	};
+
+	struct PoolStatistics
+	{
+		// acquisitions satisfied by re-use, by the tier that supplied them
+		uint64_t local_hits{0};
+		uint64_t global_hits{0};
+		uint64_t fixed_hits{0};
+		// acquisitions that allocated; 'slack_misses' are those that did so only
+		// because of set_max_slack()
+		uint64_t misses{0};
+		uint64_t slack_misses{0};
+		// batched transfers between thread caches and the shared pool
+		uint64_t spills{0};
+		uint64_t refills{0};
+		// cross-thread releases returned to the acquiring thread, and the
+		// batches that thread drained them in
+		uint64_t remote_releases{0};
+		uint64_t remote_drains{0};
+		// buffers held by the pool (in use or free), and their storage, including
+		// fixed-size pools
+		uint64_t buffers_allocated{0};
+		uint64_t bytes_allocated{0};
+		// buffers in use, the storage they hold, and the bytes asked for
+		uint64_t buffers_in_use{0};
+		uint64_t bytes_in_use{0};
+		uint64_t bytes_requested{0};
+		// garbage collection passes (inline or by the reclaimer), and what they dropped
+		uint64_t gc_passes{0};
+		uint64_t gc_freed_buffers{0};
+		uint64_t gc_freed_bytes{0};
+		// buffers whose pages garbage collection returned to the OS instead
+		// ('SoftRelease'), and the bytes those pages spanned
+		uint64_t gc_cold_buffers{0};
+		uint64_t gc_cold_bytes{0};
+		// expired buffers garbage collection kept because their size is still
+		// in demand ('AdaptiveSizing')
+		uint64_t gc_kept_buffers{0};
+		// acquisitions of the pool lock, how many found it held, and the total
+		// time those spent waiting
+		uint64_t lock_acquisitions{0};
+		uint64_t lock_contentions{0};
+		uint64_t lock_wait_ns{0};
+		// the longest of those waits, and with 'LockProfiling', the total and
+		// longest time the lock was held
+		uint64_t lock_max_wait_ns{0};
+		uint64_t lock_hold_ns{0};
+		uint64_t lock_max_hold_ns{0};
+		// acquisitions by requested size; entry i counts requests of at most 2^i
+		// bytes that are too large for entry i - 1
+		std::array<uint64_t, histogram_buckets> size_histogram{};
+		// one entry for each thread that has a cache ('ThreadCache' policy)
+		std::vector<ThreadStatistics> threads;
+	};
+
+	// receives a buffer acquired by single_buffer_async()
+	using AcquireCallback = std::function<void(BufferPtr)>;
+
+	// what a trace hook is told about (see set_trace_hook())
+	enum class TraceEvent
+	{
+		Acquire,	// 'buffer' was handed out for 'size' bytes, and holds 'allocated'
+		Release,	// 'buffer' was returned; 'size' and 'allocated' as for 'Acquire'
+		Miss,		// a new buffer of 'allocated' bytes was created for 'size'
+		GcStart,	// a garbage collection pass began
+		GcEnd,		// the pass ended, having dealt with 'count' buffers in 'duration_ns'
+		LockWait,	// a thread waited 'duration_ns' for the pool lock
+		LockHold,	// the pool lock was held for 'duration_ns' ('LockProfiling')
+	};
+
+	struct TraceRecord
+	{
+		TraceEvent event{TraceEvent::Acquire};
+		// steady clock time of the event, in nanoseconds
+		uint64_t timestamp_ns{0};
+		const Buffer* buffer{nullptr};
+		uint32_t size{0};
+		uint32_t allocated{0};
+		uint64_t count{0};
+		uint64_t duration_ns{0};
+	};
+
+	// receives trace events, on the thread that caused them and sometimes
+	// with the pool lock held; it must not call back into the pool
+	using TraceHook = void (*)(const TraceRecord& record, void* context);
+
+	// a number of buffers of one size, for reserve()
+	struct Reservation
+	{
+		uint32_t size{0};
+		uint32_t count{0};
+	};
 
 public: // methods
+	BufferPool();
+	BufferPool(const BufferPool&) = delete;
+	BufferPool& operator=(const BufferPool&) = delete;
+	~BufferPool();
+
 	/*!
-	Initialize the state of the buffer PersistentBuffer before beginning to
+	The pool behind the PersistentBuffer interface, created on first use.
+
+	\return The process-wide default pool.
+	*/
+	static BufferPool& default_pool()
+	{
+		static BufferPool pool;
+		return pool;
+	}
+
+	/*!
+	Initialize the state of the pool before beginning to
 	use it.  This initialization sets the 'ExpandAsNeeded' and
 	'ZeroBuffer' policies as the default policies, and no age-based
 	garbage collection.  You will need to call other methods to
-	configure the PersistentBuffer for different policies and behaviors,
+	configure the pool for different policies and behaviors,
 	if these do not fit your needs, BEFORE you begin using it.
+
+	A size class layout may also be selected.  Requests that fall within
+	a size class are rounded up to the class size and served from that
+	class's free list in constant time; requests larger than the biggest
+	class (or all requests, with 'BinLayout::None') are allocated at
+	exactly the requested size and located by binary search.
+
+	\param layout The size class layout to use.
+	\param spacing The ratio between adjacent classes for 'BinLayout::Geometric'.
 	*/
-	static void initialize();
+	void initialize(BinLayout layout = BinLayout::None, double spacing = 1.25);
+	/*!
+	Initialize the pool with an explicit set of size classes.
+
+	\param size_classes The class sizes, in bytes.  Order does not matter.
+	*/
+	void initialize(const std::vector<uint32_t>& size_classes);
+
+	/*!
+	Reports the number of bytes that would be allocated to satisfy a
+	request of the given size under the current size class layout.
+	With 'AdaptiveSizing', a request outside the size classes whose step of
+	the request histogram is popular (at least a sixteenth of recent
+	requests) is rounded up to the top of that step, within the limit set by
+	set_max_slack(), so that the buffer can serve any later request there.
+
+	\param min_size The requested size.
+	\return The size of the matching class, or 'min_size' if no class applies.
+	*/
+	uint32_t size_class(uint32_t min_size);
 
 	/*!
-	The PersistentBuffer can be instructed to usage-expire buffers by setting
+	A pool can be instructed to usage-expire buffers by setting
 	a time-out value using this method.  Buffers that have not been
 	reused within the indicated time range since they were last used
 	will have their resources returned to the operating system.
 
+	With the 'SoftRelease' policy as well, an expired buffer is first made
+	cold: it keeps its place in the pool and its address range, but its
+	pages are given back with madvise() (MEM_RESET on Windows), to be
+	faulted back in if it is reused.  Only a cold buffer that stays idle
+	for another 'seconds' is dropped.  Buffers smaller than a page, and
+	those in a map_arena() file, are dropped as before.
+
+	With the 'AdaptiveSizing' policy, the pool keeps a histogram of
+	requested sizes, in steps of a quarter of a power of two, that halves
+	every 'seconds'.  Each sixteenth of recent requests that an expired
+	buffer could serve earns its size one buffer that is kept (and
+	restamped) instead of dropped, so no more than about sixteen idle
+	buffers outlive each pass for being in demand.  Buffers are still
+	dropped, in demand or not, to bring the pool under its high watermark
+	or capacity.
+
 	\note Automatically sets the 'DropOld' policy.
 
 	\param seconds The amount of time that must elapse before the buffer will be released from the pool.
 	*/
-	static void set_cleanup_timeout(time_t seconds = 0);
+	void set_cleanup_timeout(time_t seconds = 0);
+
+	/*!
+	Start a background thread that trims the pool, instead of collecting
+	garbage inline on the acquisition (miss) path.  The thread wakes every
+	'interval_ms' and releases expired buffers (see set_cleanup_timeout())
+	in batches of at most 'batch_size', dropping the lock between batches
+	so other threads are never held up for long.
+
+	If 'high_watermark' is non-zero, the thread is also woken as soon as
+	the pool holds more than that many bytes, and it then releases the
+	least recently used free buffers, regardless of age, until the pool is
+	back under 7/8 of it.
+
+	With the 'ZeroBuffer' and 'ZeroOnRelease' policies, buffers released to
+	the shared pool are zeroed by this thread rather than the releasing one.
+	Until it gets to them they are still available, but are then zeroed by
+	the thread that acquires them.
+
+	\param interval_ms The time between time-based passes, in milliseconds.
+	\param high_watermark The pooled byte count that triggers reclamation (0 to disable).
+	\param batch_size The maximum number of buffers released under one lock acquisition.
+	*/
+	void start_reclaimer(uint32_t interval_ms = 1000, size_t high_watermark = 0, size_t batch_size = 64);
 	/*!
-	This method checks to see if a PersistentBuffer policy is currently
+	Stop the background reclamation thread, if it is running.  Garbage
+	collection returns to the acquisition path.
+	*/
+	void stop_reclaimer();
+	/*!
+	Set how stale a buffer's release time-stamp may be.  With a non-zero
+	resolution, releases read a coarse clock that the background reclaimer
+	(see start_reclaimer()) refreshes at that interval, instead of reading
+	the system clock for every buffer.  At zero, or while no reclaimer is
+	running, the system clock is read on each release (once per batch for
+	release_buffers()).
+
+	\param seconds The coarse clock resolution, in seconds (0 to read the system clock).
+	*/
+	void set_clock_resolution(uint32_t seconds);
+
+	/*!
+	Reports the number of bytes of storage held by the general pool (in use
+	or free), excluding fixed-size pools.
+
+	\return The pooled byte count.
+	*/
+	size_t bytes_pooled();
+	/*!
+	This method checks to see if a pool policy is currently
 	in effect.
 
 	\param policy The policy to check.
 	*/
-	static bool policy_is_active(Policy policy) { return m_policies[policy] != 0; }
+	bool policy_is_active(Policy policy) { return m_policies[policy] != 0; }
 	/*!
-	Enable the indicated PersistentBuffer policy.
+	Enable the indicated pool policy.
 
 	\param policy The policy to enable.
 	*/
-	static void set_policy(Policy policy);
+	void set_policy(Policy policy);
 	/*!
-	Enable multiple PersistentBuffer policies at once.  Any currently enabled
+	Enable multiple pool policies at once.  Any currently enabled
 	policies are cleared before processing the provided list.
 
 	\param policies An initialize list of policies to enable.
 	*/
-	static void set_policy(std::initializer_list<Policy> policies);
+	void set_policy(std::initializer_list<Policy> policies);
 	/*!
-	Disable the indicated PersistentBuffer policy.
+	Disable the indicated pool policy.
 
 	\param policy The policy to disable.
 	*/
-	static void clear_policy(Policy policy);
+	void clear_policy(Policy policy);
 
 	/*!
 	Reports the number of buffers that are currently in use
 
-	\return The number of buffers that the PersistentBuffer has in active use.
+	\return The number of buffers that the pool has in active use.
 	*/
-	static size_t buffers_in_use() { return m_buffers_in_use; }
+	size_t buffers_in_use();
 
 	/*!
 	Reports the number of buffers that are allocated for use (either active
 	or pending).
 
-	\return The number of buffers that the PersistentBuffer has allocated.
+	\return The number of buffers that the pool has allocated.
+	*/
+	size_t buffers_available();
+
+	/*!
+	Set the maximum number of free buffers each thread may hold in its local
+	cache when the 'ThreadCache' policy is active.  When a thread's cache
+	exceeds this count, half of it is returned to the shared pool in a
+	single batch.
+
+	A buffer released on a thread other than the one that acquired it is
+	pushed, without taking the pool lock, onto a return queue belonging to
+	the acquiring thread, which takes in the whole queue at once the next
+	time its cache cannot satisfy a request.  Each queue holds at most this
+	many buffers; past that, or once the acquiring thread has exited, the
+	releasing thread keeps the buffer in its own cache instead.
+
+	\param buffers The per-thread cache capacity (minimum of 2).
+	*/
+	void set_thread_cache_capacity(size_t buffers);
+
+	/*!
+	Return all free buffers held in the calling thread's local cache to the
+	shared pool.  Caches are flushed automatically when their thread exits.
+	*/
+	void flush_thread_cache();
+
+	/*!
+	Reports acquisition counters for the local (per-thread) and global
+	(shared pool) tiers.
+
+	\return A snapshot of the current counter values.
 	*/
-	static size_t buffers_available() { return m_size_list.size(); }
+	CacheStatistics cache_statistics();
+
+	/*!
+	Limit how oversized a re-used buffer may be.  A request for 'min_size'
+	bytes skips free buffers larger than 'min_size' plus 'percent' of it
+	(or plus 16 bytes, whichever is more) and allocates instead, so that
+	large buffers are kept for large requests.  This applies to buffers
+	outside the size classes; those are bounded by the class spacing.
+
+	\param percent The largest acceptable waste, as a percentage of the request (0 for no limit).
+	*/
+	void set_max_slack(uint32_t percent = 0);
+
+	/*!
+	Bound the general pool.  Once acquiring a new buffer would take the
+	pool over 'max_bytes' (including free buffers; fixed-size pools are
+	not counted), the least recently used free buffers are dropped to make
+	room, and if that is not enough the acquisition cannot be satisfied.
+	Free buffers over a lowered 'max_bytes' are dropped right away.
+	'max_class_buffers' bounds each size class in the same way, by buffer
+	count.  An acquisition that cannot be satisfied returns null from
+	try_single_buffer(), waits in single_buffer_wait(), is queued by
+	single_buffer_async(), and throws std::bad_alloc anywhere else.
+
+	\note With 'ThreadCache', free buffers held in another thread's cache
+	are not available until that cache spills them.
+
+	\param max_bytes The largest number of bytes the pool may hold (0 for no limit).
+	\param max_class_buffers The most buffers each size class may hold (0 for no limit).
+	*/
+	void set_capacity(size_t max_bytes = 0, size_t max_class_buffers = 0);
+
+	/*!
+	Reports the internal fragmentation of the buffers currently in use.
+
+	\return A snapshot of the current counter values.
+	*/
+	FragmentationStatistics fragmentation_statistics();
+
+	/*!
+	Reports every counter the pool keeps, for polling by a
+	metrics exporter.  The counters are maintained at all times with
+	relaxed atomic updates, so they cost next to nothing to keep; taking a
+	snapshot holds the pool lock only long enough to total the
+	pool and visit the thread caches.  Event counts are cumulative over the
+	life of the pool.
+
+	\return A snapshot of the current counter values.
+	*/
+	PoolStatistics snapshot_stats();
+
+	/*!
+	Pre-allocate a pool of buffers of one exact size that are acquired and
+	released through a lock-free stack, without ever taking the
+	pool lock.  Requests for exactly 'size' bytes are served
+	from this pool while it has free buffers; once it is exhausted, they
+	fall back to the general path.
+
+	\note Register fixed pools during start-up, BEFORE the pool is in use.
+
+	\param size The exact buffer size, in bytes.
+	\param count The number of buffers to pre-allocate.
+	\return False if 'size' is already registered or the pool limit has been reached.
+	*/
+	bool register_fixed_pool(uint32_t size, uint32_t count);
+
+	/*!
+	Populate the general pool with free buffers ahead of demand, so that
+	the first requests for these sizes are served by re-use instead of
+	taking the miss path.  Sizes are rounded up to their size class, as
+	requests are.  The storage is allocated under a single lock
+	acquisition, and zeroed ('ZeroBuffer') or pre-faulted outside it.
+	The reservation counts against the capacity limits (see
+	set_capacity()) as a whole: free buffers are dropped to make room for
+	it, and if that is not enough nothing is reserved.
+
+	\param reservations The sizes to reserve, and how many buffers of each.
+	\param prefault Touch every page now, so that first use does not fault them in.
+	\return False if the reservation would take the pool over its capacity.
+	*/
+	bool reserve(const std::vector<Reservation>& reservations, bool prefault = false);
+
+	/*!
+	Reports the shape of the general pool: the number of buffers it holds
+	(in use or free) of each allocation size, smallest first.  Once the
+	pool has converged on a workload, passing this to reserve() on the
+	next start gives that run a warm pool from the outset.  Fixed-size
+	pools are not included.
+
+	\return One entry for each allocation size in the pool.
+	*/
+	std::vector<Reservation> reservation_profile();
+	/*!
+	Write reservation_profile() to a file, one "size count" line per entry.
+
+	\param path The file to write.
+	\return False if the file could not be written.
+	*/
+	bool save_reservation_profile(const std::string& path);
+	/*!
+	Reserve the buffers described by a file written by
+	save_reservation_profile().
+
+	\param path The file to read.
+	\param prefault As for reserve().
+	\return False if the file could not be read, or reserve() refused it.
+	*/
+	bool load_reservation_profile(const std::string& path, bool prefault = false);
+
+	/*!
+	Configure the slabs used for buffer storage when the 'Arena' policy is
+	active.  Slabs are mapped directly from the operating system and buffer
+	storage is carved from them sequentially; a slab is returned to the
+	operating system once every buffer carved from it has been dropped
+	(by garbage collection or reset()).  Requests larger than half a slab
+	are given a slab of their own.
+
+	\note Automatically sets the 'Arena' policy.
+
+	\param slab_size The size of each slab, in bytes (default 64 MiB).
+	\param huge_pages Request huge pages for slabs (MAP_HUGETLB, falling back to transparent huge pages).
+	*/
+	void set_arena(size_t slab_size = 64 * 1024 * 1024, bool huge_pages = false);
+
+	/*!
+	Carve 'Arena' storage from a memory-mapped file, so that the pool
+	outlives the process.  The file holds a table that locates, by
+	offset, every buffer carved from it; when a restarted process maps
+	the file again, those buffers are restored to the pool as free
+	buffers, contents and all, instead of being allocated afresh.  Once
+	the file is full, storage comes from ordinary slabs.
+
+	Only one pool may map a file at a time.  Other processes may map it
+	themselves, with mmap(), and read a buffer at the offset reported by
+	mapped_offset() without copying it.  A file under /dev/shm is a
+	shared-memory segment.
+
+	\note Automatically sets the 'Arena' policy.  Not available on Windows.
+
+	\param path The file to map; it is created if it does not exist.
+	\param size The size to create the file with; an existing file keeps its own.
+	\return False if the file could not be mapped, is mapped by another pool, is not a pool file,
+	or holds more buffers than the capacity limits allow (see set_capacity()).
+	*/
+	bool map_arena(const std::string& path, size_t size = 256 * 1024 * 1024);
+	/*!
+	Reports where a buffer's storage lies in the file mapped by map_arena().
+
+	\param buffer The buffer to locate.
+	\return The offset of the storage in the file, or -1 if it is not in one.
+	*/
+	int64_t mapped_offset(const BufferPtr& buffer);
+
+	/*!
+	Set the minimum alignment of buffer storage, for SIMD code or
+	unbuffered (O_DIRECT) I/O.  This applies to all storage allocated from
+	then on, including fixed-size pools, so it should be set BEFORE you
+	begin using the pool; buffers already pooled keep the
+	alignment they were allocated with.
+
+	\param alignment The alignment in bytes; a power of two, or 0 for the heap's default.
+	*/
+	void set_alignment(size_t alignment);
 
 	/*!
 	Clear all currently allocated buffers and start from scratch
 	*/
-	static void reset();
+	void reset();
 
 	/*!
-	Retrieve a buffer from the PersistentBuffer that contains the minimum
+	Retrieve a buffer from the pool that contains the minimum
 	number of bytes requested.  This may re-use a previously
 	allocated buffer if its size matches the requirement.
 
 	\param min_size The minimum amount of bytes the buffer must provide.
-	\return A std::shared_ptr to the memory of the PersistentBuffer buffer.
+	\return A std::shared_ptr to the memory of the pooled buffer.
 	*/
-	static BufferPtr single_buffer(uint32_t min_size
-#if PERSISTENTBUFFER_TRACKING >= 2
-	, const tracking_data_t& caller = tracking_data_t()
-#endif
-	);
+	BufferPtr single_buffer(uint32_t min_size);
+	BufferPtr single_buffer(uint32_t min_size, const tracking_data_t& caller);
+
+	/*!
+	Retrieve a buffer of a size known at compile time.  The size class
+	for 'N' is resolved the first time it is asked for under the current
+	layout, and remembered, so subsequent calls go straight to its free
+	list without searching the layout for it.  The class is remembered per
+	pool id modulo 'sized_cache_slots'; pools sharing a slot stay correct,
+	but resolve the class again whenever they take turns on it.
+
+	\return A std::shared_ptr to the memory of the pooled buffer.
+	*/
+	template <uint32_t N>
+	BufferPtr single_buffer()
+	{
+		static SizedCache cached_bins{};
+		return acquire_sized(N, cached_bins, true);
+	}
+	/*!
+	Retrieve a buffer of a size known at compile time (as above), and
+	copy that many bytes of content into it.
+
+	\param data The raw data to be placed into the buffer; 'N' bytes.
+	\return A std::shared_ptr to the memory of the pooled buffer.
+	*/
+	template <uint32_t N>
+	BufferPtr single_buffer_from(const uint8_t* data)
+	{
+		static SizedCache cached_bins{};
+		auto buffer{acquire_sized(N, cached_bins, false)};
+		memcpy(buffer->rw(), data, N);
+		return buffer;
+	}
 
 	/*!
-	Retrieve a buffer from the PersistentBuffer that contains at least
+	Retrieve several buffers at once, taking the lock no more than once
+	for the whole batch; the counterpart of release_buffers().  Requests are
+	matched in ascending size order, so the pool's size index is traversed
+	only once, but the results are placed in the order they were asked for.
+
+	\param sizes The minimum amount of bytes each buffer must provide.
+	\param buffers Receives one buffer for each entry in 'sizes'.
+	*/
+	void acquire_buffers(const std::vector<uint32_t>& sizes, std::vector<BufferPtr>& buffers);
+	void acquire_buffers(const std::vector<uint32_t>& sizes, std::vector<BufferPtr>& buffers, const tracking_data_t& caller);
+
+	/*!
+	Retrieve a buffer from the pool that contains at least
 	the number of bytes requested.  Additionally, place the provided
 	content into the buffer before returning it to the caller.
 
 	\param data The raw data to be placed into the buffer.
 	\param size The number of bytes in the provided content.
-	\return A std::shared_ptr to the memory of the PersistentBuffer buffer.
+	\return A std::shared_ptr to the memory of the pooled buffer.
 	*/
-	static BufferPtr single_buffer_from(const uint8_t* data, uint32_t size
-#if PERSISTENTBUFFER_TRACKING >= 2
-	, const tracking_data_t& caller = tracking_data_t()
-#endif
-	);
+	BufferPtr single_buffer_from(const uint8_t* data, uint32_t size);
+	BufferPtr single_buffer_from(const uint8_t* data, uint32_t size, const tracking_data_t& caller);
 
 	/*!
-	Retrieve a buffer from the PersistentBuffer that contains at least
+	Retrieve a buffer from the pool that contains at least
 	the number of bytes requested.  Additionally, place the provided
 	content into the buffer before returning it to the caller.
 
 	\param data The raw data to be placed into the buffer.
 	\param size The number of bytes in the provided content.
-	\return A std::shared_ptr to the memory of the PersistentBuffer buffer.
+	\return A std::shared_ptr to the memory of the pooled buffer.
 	*/
-	static BufferPtr single_buffer_from(const char* data, size_t size
-#if PERSISTENTBUFFER_TRACKING >= 2
-	, const tracking_data_t& caller = tracking_data_t()
-#endif
-	);
+	BufferPtr single_buffer_from(const char* data, size_t size);
+	BufferPtr single_buffer_from(const char* data, size_t size, const tracking_data_t& caller);
 
 	/*!
-	Retrieve a buffer from the PersistentBuffer that that can hold the
+	Retrieve a buffer from the pool that that can hold the
 	value in the provided string, and copy that string data into it.
 
 	\param data The string value to be placed into the buffer.
-	\return A std::shared_ptr to the memory of the PersistentBuffer buffer.
+	\return A std::shared_ptr to the memory of the pooled buffer.
+	*/
+	BufferPtr single_buffer_from(const std::string& data);
+	BufferPtr single_buffer_from(const std::string& data, const tracking_data_t& caller);
+
+	/*!
+	Retrieve a buffer that is released back to the pool
+	automatically when the returned owner is destroyed.
+
+	\param min_size The minimum amount of bytes the buffer must provide.
+	\return A move-only owner of the buffer.
+	*/
+	ScopedBuffer scoped_buffer(uint32_t min_size);
+
+	/*!
+	Retrieve a buffer through an intrusive, reference-counted handle.  The
+	buffer is released back to the pool automatically when the
+	last copy of the handle is destroyed.
+
+	\param min_size The minimum amount of bytes the buffer must provide.
+	\return A handle to the buffer.
+	*/
+	BufferHandle buffer_handle(uint32_t min_size);
+
+	/*!
+	Retrieve a chain of buffers, one for each entry in 'sizes', through
+	acquire_buffers().  The chain releases them all together, with a single
+	call to release_buffers().
+
+	\param sizes The minimum amount of bytes each segment must provide.
+	\return The chain, with its segments in the order they were asked for.
 	*/
-	static BufferPtr single_buffer_from(const std::string& data
-#if PERSISTENTBUFFER_TRACKING >= 2
-	, const tracking_data_t& caller = tracking_data_t()
+	BufferChain acquire_chain(const std::vector<uint32_t>& sizes);
+
+	/*!
+	Retrieve a buffer, or nothing if the pool is at its capacity (see
+	set_capacity()) and none of the buffers it holds can be used.
+
+	\param min_size The minimum amount of bytes the buffer must provide.
+	\return The buffer, or null.
+	*/
+	BufferPtr try_single_buffer(uint32_t min_size);
+	/*!
+	Retrieve a buffer, waiting up to 'timeout' for one to be released if
+	the pool is at its capacity.
+
+	\param min_size The minimum amount of bytes the buffer must provide.
+	\param timeout How long to wait for room.
+	\return The buffer, or null if the time ran out.
+	*/
+	BufferPtr single_buffer_wait(uint32_t min_size, std::chrono::milliseconds timeout);
+	/*!
+	Retrieve a buffer without blocking.  If the pool has room, 'callback'
+	is invoked before this returns; otherwise the request is queued, and
+	'callback' is invoked by the thread whose release (or garbage
+	collection) makes room for it, once that thread has released the pool
+	lock.  Queued requests are served in order.  They are discarded,
+	uninvoked, if the pool is destroyed first.
+
+	\param min_size The minimum amount of bytes the buffer must provide.
+	\param callback Receives the buffer.
+	*/
+	void single_buffer_async(uint32_t min_size, AcquireCallback callback);
+
+#if defined(__cpp_impl_coroutine)
+	// 'co_await pool.acquire_async(size)' suspends the coroutine until
+	// single_buffer_async() delivers the buffer, and resumes it on the
+	// thread that delivered it
+	struct AcquireAwaitable
+	{
+		BufferPool& m_pool;
+		uint32_t m_size;
+		BufferPtr m_buffer;
+
+		bool await_ready()
+		{
+			m_buffer = m_pool.try_single_buffer(m_size);
+			return static_cast<bool>(m_buffer);
+		}
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			m_pool.single_buffer_async(m_size, [this, handle](BufferPtr buffer) {
+				m_buffer = std::move(buffer);
+				handle.resume();
+			});
+		}
+		BufferPtr await_resume() { return std::move(m_buffer); }
+	};
+	AcquireAwaitable acquire_async(uint32_t min_size) { return AcquireAwaitable{*this, min_size, nullptr}; }
 #endif
-	);
+
+	/*!
+	Change the size of a buffer that is in use, keeping its content, like
+	realloc().  If the buffer's storage already has room, only its size
+	changes.  Otherwise its content is moved to a pooled buffer that fits,
+	under a single lock acquisition, and 'buffer' is pointed at that one
+	(in 'Arena' mode, storage in a slab of its own is grown with mremap()
+	instead, where the platform has it).  With 'ZeroBuffer', any bytes
+	the buffer gains are zeroed.
+
+	\param buffer The buffer to resize; it may be replaced.
+	\param new_size The number of bytes the buffer must now provide.
+	\return False if 'buffer' is not in use, or if the pool is at its capacity (see set_capacity()).
+	*/
+	bool resize_buffer(BufferPtr& buffer, uint32_t new_size);
 
 	/*!
 	Checks to see if a BufferPtr is currently holding valid content.
 
 	\param buffer The buffer to check.
 	*/
-	static bool buffer_in_use(BufferPtr buffer);
-	static bool release_buffer(BufferPtr buffer
-#if PERSISTENTBUFFER_TRACKING >= 2
-	, const tracking_data_t& caller = tracking_data_t()
-#endif
-	);
-	static bool release_buffers(const std::vector<PersistentBuffer::BufferPtr>& buffers
-#if PERSISTENTBUFFER_TRACKING >= 2
-	, const tracking_data_t& caller = tracking_data_t()
-#endif
-	);
+	bool buffer_in_use(const BufferPtr& buffer);
+	bool release_buffer(const BufferPtr& buffer);
+	bool release_buffer(const BufferPtr& buffer, const tracking_data_t& caller);
+	bool release_buffers(const std::vector<BufferPtr>& buffers);
+	bool release_buffers(const std::vector<BufferPtr>& buffers, const tracking_data_t& caller);
 
-#if PERSISTENTBUFFER_TRACKING >= 2
-	static void report_tracking();
-#endif
+	/*!
+	Capture a backtrace for one in every 'one_in' tracked acquisitions, to
+	be shown by report_tracking() along with the call site.  Each capture
+	walks the stack, so on live traffic sample sparingly.  The rate applies
+	to every pool.
+
+	\param one_in The sampling interval (0 captures none; 1 captures all).
+	*/
+	static void set_tracking_sample_rate(uint32_t one_in);
+
+	/*!
+	Write a summary of the buffers that are currently in use to stderr,
+	grouped by the call site that acquired them and largest first, followed
+	by the backtraces of any sampled acquisitions.  Only acquisitions that
+	supplied tracking data (PERSISTENTBUFFER_TRACKING_DATA) while the
+	'Tracking' policy was active are included.
+	*/
+	void report_tracking();
+
+	/*!
+	Install a function to be called on every acquisition, release and miss,
+	at the start and end of each garbage collection pass, whenever a thread
+	has to wait for the pool lock, and (with the 'LockProfiling' policy)
+	whenever the lock is let go.  A null 'hook' removes it.  Set the hook
+	before the pool is shared between threads, or while it is idle.
+
+	The same events are also available as USDT probes (provider
+	"persistentbuffer") where <sys/sdt.h> is available, so that bpftrace
+	or perf can attach to them without a hook or a rebuild.  Define
+	PERSISTENTBUFFER_NO_USDT to leave them out.
+
+	\param hook The function to call, or null for none.
+	\param context Passed to every call of 'hook'.
+	*/
+	void set_trace_hook(TraceHook hook, void* context = nullptr);
 
 private: // aliases and enums
-	using BufferMap = std::map<BufferPtr, bool>;
-	using BufferMapKey = std::pair<BufferPtr, bool>;
+	using BufferTable = std::vector<BufferPtr>;
+	using SlotList = std::vector<uint32_t>;
 	using SizeList = std::vector<BufferPtr>;
 
+	struct LocalCache;
+	struct ReclaimerState;
+
+	// the pool lock.  with 'LockProfiling', it also times how long it is held
+	class PoolMutex
+	{
+	public:
+		explicit PoolMutex(BufferPool& pool) : m_pool(pool) {}
+
+		void lock();
+		bool try_lock();
+		void unlock();
+
+	private:
+		BufferPool& m_pool;
+		std::mutex m_mutex;
+		// when the current holder took the lock; zero if it is not being timed
+		uint64_t m_held_since{0};
+	};
+	using BuffersLock = std::unique_lock<PoolMutex>;
+
+	// NUMA nodes beyond this are folded onto the lower ones
+	static constexpr int max_numa_nodes{8};
+	// where the node can only be had from a system call, it is looked up
+	// once in this many calls to current_node()
+	static constexpr uint32_t node_refresh_interval{64};
+	// steps of the 'AdaptiveSizing' request histogram
+	static constexpr int demand_buckets{histogram_buckets * 4};
+
+	struct Bin
+	{
+		// the allocation size of every buffer in this class
+		uint32_t m_size{0};
+		// heads of the intrusive lists of free buffers in this class, one per NUMA
+		// node; everything is on node 0 unless 'NumaAware' is active
+		std::array<Buffer*, max_numa_nodes> m_free{};
+		size_t m_free_count{0};
+		// every buffer in this class, in use or free (see set_capacity())
+		size_t m_count{0};
+	};
+	using BinList = std::vector<Bin>;
+
+	struct FixedPool;
+	static constexpr int max_fixed_pools{8};
+
+	// the size class argument of a request whose class has not been looked up
+	static constexpr int32_t unknown_bin{-2};
+	// the size classes remembered by single_buffer<N>(), one per pool id
+	// modulo this
+	static constexpr size_t sized_cache_slots{4};
+	using SizedCache = std::array<std::atomic<uint64_t>, sized_cache_slots>;
+
 private: // methods
 	// release any buffers that haven't been used in a given timeout period
-	static void garbage_collect(time_t start_time);
+	void garbage_collect(time_t start_time);
+	// releases up to 'limit' of the oldest free buffers that have either
+	// expired or must go to bring the pool down to 'target_bytes'; with
+	// 'AdaptiveSizing', expired buffers of sizes still in demand are kept, and
+	// with 'SoftRelease', the rest are made cold first.  returns the number
+	// released, made cold or kept.  does not lock the mutex
+	size_t reclaim(time_t now, size_t limit, size_t target_bytes);
+	// body of the background reclamation thread
+	void reclaimer_main();
+	// the release time-stamp: the coarse clock if it is being kept, else time()
+	time_t clock_now();
+	// locks 'm_buffers_lock', accounting for any time spent waiting on it
+	BuffersLock lock_buffers();
+	// accounts for, and traces, the time 'm_buffers_lock' was held
+	// ('LockProfiling'); called with it held
+	void lock_held(uint64_t held_ns);
+	// reports an event to the trace hook, if there is one
+	void trace(TraceEvent event, const Buffer* buffer = nullptr, uint32_t size = 0, uint32_t allocated = 0,
+			   uint64_t count = 0, uint64_t duration_ns = 0);
+	// the start and end of a garbage collection pass, for tracing.  the start
+	// returns the time it was traced at, to be handed to the end
+	uint64_t gc_started();
+	void gc_ended(uint64_t started, size_t handled);
+	// writes the pool's usage counts to stderr ('UsageReport')
+	void report_usage();
+	// record, clear or transfer a buffer's call site.  these do not lock the
+	// mutex
+	void track_acquire(Buffer* buffer, const tracking_data_t& caller);
+	void track_release(Buffer* buffer);
+	void track_move(Buffer* from, Buffer* to);
+	// with 'bin' the class of an 'allocated'-byte buffer, makes room for it
+	// under the capacity limits, if it can.  does not lock the mutex
+	bool make_room(uint32_t allocated, int32_t bin);
+	// as above, for 'bytes' of new buffers arriving at once, 'class_counts[i]'
+	// of them in class i.  does not lock the mutex
+	bool make_room(size_t bytes, const std::vector<size_t>& class_counts);
+	// after buffers have been released or dropped: wakes single_buffer_wait()
+	// and serves queued single_buffer_async() requests.  the caller must not
+	// hold the mutex
+	void capacity_released();
+	// acquire() without throwing when the pool is at its capacity; returns
+	// null instead
+	BufferPtr try_acquire(uint32_t min_size, bool zero = true, int32_t bin = unknown_bin);
+	// lets the reclaimer know it has work to do ahead of its next interval
+	void wake_reclaimer();
+	// zeroes, in batches of 'batch_size' and outside the lock, the buffers left
+	// for the reclaimer under 'ZeroOnRelease', then returns them to the pool
+	void scrub_pending(size_t batch_size);
+	// with 'ZeroOnRelease', zeroes a buffer on its way back to the pool,
+	// unless it is bound for the shared pool and the reclaimer will do it
+	void zero_released(const BufferPtr& buffer);
 
 	// this is the single-buffer working method, but it does not lock the mutex.
-	// this is so it can be used by multiple public methods
-	static BufferPtr single_buffer_unprotected(uint32_t min_size);
+	// this is so it can be used by multiple public methods.  a batch of
+	// ascending requests can pass 'cursor' to resume the size index search
+	// where the previous request left off.
+	// 'bin' is the size class of 'min_size', if the caller already knows it.
+	// 'node' is from acquire_node(), taken before the lock
+	BufferPtr single_buffer_unprotected(uint32_t min_size, uint32_t node, size_t* cursor = nullptr, int32_t bin = unknown_bin);
+
+	// acquisition entry point shared by the public methods; consults the
+	// calling thread's cache first when the 'ThreadCache' policy is active.
+	// 'zero' may be cleared by callers that overwrite the whole buffer
+	BufferPtr acquire(uint32_t min_size, bool zero = true, int32_t bin = unknown_bin);
+	// acquisition for single_buffer<N>(); the slot of 'cached_bins' for this
+	// pool remembers the size class of 'min_size' and the layout it was found in
+	BufferPtr acquire_sized(uint32_t min_size, SizedCache& cached_bins, bool zero);
+	// the last step of every acquisition, once the buffer is ours alone
+	void finish_acquire(Buffer* buffer, bool zero);
+	// the largest 'm_allocated' a request may be served from (see set_max_slack())
+	uint32_t slack_limit(uint32_t min_size);
+	// 'AdaptiveSizing': the size to allocate for an exact-size request, the
+	// recent requests a free buffer could serve, the periodic halving of the
+	// request histogram, and the gathering of the thread caches' counts into
+	// it.  these do not lock the mutex
+	uint32_t adaptive_size(uint32_t min_size);
+	uint64_t served_demand(const Buffer* buffer);
+	void decay_demand(time_t now);
+	void fold_demand(time_t now);
+	// keeps the in-use counts behind buffers_in_use(), snapshot_stats() and
+	// fragmentation_statistics(), and traces acquisitions and releases.
+	// counts go to the calling thread's cache where it has one
+	void count_in_use(const Buffer* buffer, bool acquired);
+	// those counts, summed over the pool and every thread cache; the caller
+	// must hold 'm_buffers_lock'
+	struct UsageTotals
+	{
+		int64_t m_buffers{0};
+		uint64_t m_requested_bytes{0};
+		uint64_t m_in_use_bytes{0};
+	};
+	UsageTotals usage_unprotected();
+	// releases a buffer held by a ScopedBuffer or the last BufferHandle to
+	// the pool it came from
+	static void release_pinned(Buffer* buffer);
+	// adds newly created buffers to the shared pool as free buffers, stamped
+	// 'now'; does not lock the mutex
+	void pool_free_buffers(std::vector<BufferPtr>& buffers, time_t now);
+	// brings a released buffer's entry in its pool file up to date
+	static void update_record(Buffer* buffer, time_t now);
+	// add a new buffer to, or remove one from, the registry; these do not
+	// lock the mutex
+	void register_buffer(const BufferPtr& buffer);
+	void unregister_buffer(const BufferPtr& buffer);
+
+	// age list of free buffers held by the shared pool; these do not lock
+	// the mutex
+	void age_push(Buffer* buffer);
+	void age_remove(Buffer* buffer);
+
+	// marks a buffer as free; does not lock the mutex
+	void release_unprotected(const BufferPtr& buffer, time_t now);
+
+	// size class engine; these do not lock the mutex
+	void build_bins(std::vector<uint32_t> sizes);
+	int32_t bin_index(uint32_t min_size);
+	void bin_push(Buffer* buffer);
+	// takes from 'node' if it has a free buffer, and any other node if not
+	BufferPtr bin_pop(Bin& bin, uint32_t node);
+	void bin_remove(Buffer* buffer);
+
+	// obtains storage for a new buffer, from the current slab in 'Arena' mode
+	// or the heap otherwise.  slabs are bound to 'node', if it is not -1.
+	// 'zeroed' is set if the memory is known to be zero-filled already, and
+	// 'dedicated' (if given) to a slab that holds nothing else.  does not lock
+	// the mutex
+	Buffer::DataPtr allocate_storage(uint32_t size, int32_t node, bool& zeroed, Slab** dedicated = nullptr);
+	// the NUMA node the calling thread is running on, below 'max_numa_nodes'
+	static uint32_t current_node();
+	// the node to acquire from: the current one in 'NumaAware' mode, else 0
+	uint32_t acquire_node() const { return m_policies[Policy::NumaAware] ? current_node() : 0; }
+
+	// lock-free fixed-size pools
+	BufferPtr fixed_pool_acquire(uint32_t min_size);
+	void fixed_pool_release(const BufferPtr& buffer, time_t now);
+
+	// thread-cache tier
+	// the calling thread's cache for this pool, created on first use
+	LocalCache& thread_cache();
+	// the cache the calling thread used last, of whichever pool; never
+	// creates one, so it can be used under the lock
+	static LocalCache*& last_thread_cache();
+	BufferPtr thread_cache_acquire(uint32_t min_size, int32_t bin = unknown_bin);
+	// takes a buffer from the calling thread's cache only; null if none fits
+	BufferPtr thread_cache_take(LocalCache& cache, uint32_t min_size);
+	bool thread_cache_release(const BufferPtr& buffer, time_t now);
+	void thread_cache_trim();
+	void thread_cache_spill(LocalCache& cache, size_t count);
+	// hands a buffer back to the thread that acquired it; false if that
+	// thread's queue is closed or full.  lock-free
+	bool remote_push(RemoteQueue& queue, Buffer* buffer);
+	// moves everything other threads have handed back into 'cache', closing
+	// its queue in the same step if 'close' is set; returns the number of
+	// buffers taken.  lock-free
+	size_t remote_drain(LocalCache& cache, bool close = false);
+	// an unowned return queue for a new cache; the caller must hold
+	// 'm_buffers_lock'
+	RemoteQueue* claim_remote_queue();
 
 private: // data members
-	static time_t m_cleanup_timeout; // zero means do not garbage collect; !zero is in seconds
-	static time_t m_last_cleanup_check;
+	// distinguishes this pool from any other that has existed, so that thread
+	// caches are never matched to a pool that took a destroyed one's address
+	uint64_t m_id{0};
+	bool m_initialized{false};
 
-	static std::bitset<Policy::TotalPolicies> m_policies;
+	time_t m_cleanup_timeout{0}; // zero means do not garbage collect; !zero is in seconds
+	time_t m_last_cleanup_check{0};
 
-	static std::mutex m_buffers_lock;
-	static BufferMap m_buffers;
-	static int m_buffers_in_use;
+	std::bitset<Policy::TotalPolicies> m_policies;
 
-	// this list is sorted ascending on 'm_allocated' for binary searching
-	static SizeList m_size_list;
+	PoolMutex m_buffers_lock{*this};
+	// registry of every buffer in the general pool, indexed by 'Buffer::m_slot'.
+	// slots vacated by garbage collection are recycled through 'm_free_slots',
+	// so a buffer's slot is stable for as long as it is pooled
+	BufferTable m_buffers;
+	SlotList m_free_slots;
+	size_t m_buffer_count{0};
+	// total 'm_allocated' of every registered buffer
+	size_t m_pooled_bytes{0};
+
+	// the reclaimer thread and the coarse clock it keeps
+	std::unique_ptr<ReclaimerState> m_reclaimer;
+	// background reclamation; written under 'm_buffers_lock'.  'm_scrub_list'
+	// holds the free buffers waiting for the reclaimer to zero them
+	std::atomic<bool> m_reclaimer_running{false};
+	size_t m_high_watermark{0};
+	SizeList m_scrub_list;
+
+	// thread-cache tier configuration; 'm_generation' is advanced by reset()
+	// so that caches holding buffers from a previous pool discard them
+	size_t m_thread_cache_capacity{32};
+	std::atomic<uint32_t> m_generation{0};
+	std::vector<LocalCache*> m_thread_caches; // guarded by 'm_buffers_lock'
+	// return queues, each owned by at most one cache.  they live as long as
+	// the pool, so a release never pushes onto a queue that has been freed
+	std::vector<std::unique_ptr<RemoteQueue>> m_remote_queues; // guarded by 'm_buffers_lock'
+
+	// counters.  these are only written under 'm_buffers_lock', but can be read
+	// at any time
+	CacheStatistics m_retired_stats; // folded in from exited threads; read under the lock
+	std::atomic<uint64_t> m_global_hits{0};
+	std::atomic<uint64_t> m_misses{0};
+	std::atomic<uint64_t> m_spills{0};
+	std::atomic<uint64_t> m_refills{0};
+	std::atomic<uint64_t> m_slack_misses{0};
+	std::atomic<uint64_t> m_gc_passes{0};
+	std::atomic<uint64_t> m_gc_freed_buffers{0};
+	std::atomic<uint64_t> m_gc_freed_bytes{0};
+	std::atomic<uint64_t> m_gc_cold_buffers{0};
+	std::atomic<uint64_t> m_gc_cold_bytes{0};
+	std::atomic<uint64_t> m_gc_kept_buffers{0};
+	std::atomic<uint64_t> m_lock_acquisitions{0};
+	std::atomic<uint64_t> m_lock_contentions{0};
+	std::atomic<uint64_t> m_lock_wait_ns{0};
+	std::atomic<uint64_t> m_lock_max_wait_ns{0};
+	std::atomic<uint64_t> m_lock_hold_ns{0};
+	std::atomic<uint64_t> m_lock_max_hold_ns{0};
+	// see set_trace_hook()
+	std::atomic<TraceHook> m_trace_hook{nullptr};
+	void* m_trace_context{nullptr};
+	// acquisitions by requested size (see 'PoolStatistics'), from threads
+	// without a cache and from caches that have gone
+	std::array<std::atomic<uint64_t>, histogram_buckets> m_size_histogram{};
+	// recent acquisitions by requested size, four steps to each power of two
+	// ('AdaptiveSizing'); halved every cleanup timeout, under 'm_buffers_lock'.
+	// the thread caches' counts are added in by fold_demand()
+	std::array<std::atomic<uint64_t>, demand_buckets> m_demand{};
+	time_t m_last_decay{0};
+	time_t m_last_fold{0};
+
+	// maximum re-use waste, in percent of the request; zero means unlimited
+	uint32_t m_max_slack{0};
+
+	// capacity limits (zero for none), and what is waiting on them.
+	// 'm_capacity_demand' counts the waiters and queued requests, so that
+	// releases only have to look at it; everything else is guarded by
+	// 'm_buffers_lock'
+	size_t m_capacity_bytes{0};
+	size_t m_capacity_class_buffers{0};
+	struct PendingAcquisition
+	{
+		uint32_t m_size;
+		AcquireCallback m_callback;
+	};
+	std::deque<PendingAcquisition> m_pending_acquisitions;
+	std::condition_variable_any m_capacity_freed;
+	std::atomic<int> m_capacity_demand{0};
+	// totals across in-use buffers, for threads without a cache (see
+	// count_in_use()); these are updated outside the lock
+	std::atomic<int64_t> m_buffers_in_use{0};
+	std::atomic<uint64_t> m_requested_bytes{0};
+	std::atomic<uint64_t> m_in_use_bytes{0};
+
+	// this list is sorted ascending on 'm_allocated' for binary searching.  it
+	// only holds buffers that are not in a size class ('m_bin' < 0)
+	SizeList m_size_list;
+
+	// every free buffer held by the shared pool, oldest 'm_last_used' first.
+	// buffers are appended as they are released, so the list stays ordered
+	// and garbage collection can stop at the first one that is not expired
+	Buffer* m_oldest{nullptr};
+	Buffer* m_newest{nullptr};
+
+	// size classes, sorted ascending on 'm_size'; empty if no layout is active.
+	// every layout (in every pool) is given a distinct 'm_layout_id', so
+	// that size classes remembered by single_buffer<N>() can be checked
+	BinList m_bins;
+	std::atomic<uint32_t> m_layout_id{0};
+
+	// fixed-size pools; entries below 'm_fixed_pool_count' are immutable once
+	// published, so they can be read without the lock
+	std::array<std::unique_ptr<FixedPool>, max_fixed_pools> m_fixed_pools;
+	std::atomic<int> m_fixed_pool_count{0};
+	size_t m_fixed_buffer_count{0};
+
+	// 'Arena' mode configuration and the slab currently being carved; each
+	// buffer's storage holds a reference to its slab, so a slab is unmapped
+	// once it is no longer current and its last buffer goes away
+	size_t m_slab_size{64 * 1024 * 1024};
+	bool m_huge_pages{false};
+	std::array<std::shared_ptr<Slab>, max_numa_nodes> m_current_slabs; // one per NUMA node
+	// minimum storage alignment (see set_alignment())
+	size_t m_alignment{0};
+	// the pool file storage is carved from first, if one is mapped
+	std::shared_ptr<MappedArena> m_mapped_arena;
+};
+
+/// @class PersistentBuffer
+/// @brief Static access to the default BufferPool
+///
+/// Every method forwards to BufferPool::default_pool(); see BufferPool
+/// for their documentation.
+///
+/// It is implemented as a Singleton for the following reasons:
+///     1. Persistent buffers don't need to be context-specific;
+///     2. Persistent buffers are available throughout the application
+///        space, so subsystems wishing to employ them needn't have
+///        an instance of the manager passed down to them through a
+///        long chain, unnecessarily cluttering argument lists.
+///
+/// Subsystems that would rather not share it can create a BufferPool of
+/// their own.
+class PersistentBuffer
+{
+public: // aliases and enums
+	using Policy = BufferPool::Policy;
+	static constexpr Policy ZeroBuffer{BufferPool::ZeroBuffer};
+	static constexpr Policy DropOld{BufferPool::DropOld};
+	static constexpr Policy ThreadCache{BufferPool::ThreadCache};
+	static constexpr Policy Arena{BufferPool::Arena};
+	static constexpr Policy ZeroOnRelease{BufferPool::ZeroOnRelease};
+	static constexpr Policy NumaAware{BufferPool::NumaAware};
+	static constexpr Policy Tracking{BufferPool::Tracking};
+	static constexpr Policy UsageReport{BufferPool::UsageReport};
+	static constexpr Policy SoftRelease{BufferPool::SoftRelease};
+	static constexpr Policy AdaptiveSizing{BufferPool::AdaptiveSizing};
+	static constexpr Policy LockProfiling{BufferPool::LockProfiling};
+	static constexpr Policy TotalPolicies{BufferPool::TotalPolicies};
+
+	using BinLayout = BufferPool::BinLayout;
+	using tracking_data_t = BufferPool::tracking_data_t;
+	static constexpr int tracking_frames{BufferPool::tracking_frames};
+
+	using Buffer = BufferPool::Buffer;
+	using BufferPtr = BufferPool::BufferPtr;
+	using ScopedBuffer = BufferPool::ScopedBuffer;
+	using BufferHandle = BufferPool::BufferHandle;
+	using BufferSlice = BufferPool::BufferSlice;
+	using BufferChain = BufferPool::BufferChain;
+
+	using CacheStatistics = BufferPool::CacheStatistics;
+	using FragmentationStatistics = BufferPool::FragmentationStatistics;
+	static constexpr int histogram_buckets{BufferPool::histogram_buckets};
+	using ThreadStatistics = BufferPool::ThreadStatistics;
+	using PoolStatistics = BufferPool::PoolStatistics;
+	using Reservation = BufferPool::Reservation;
+	using AcquireCallback = BufferPool::AcquireCallback;
+	using TraceEvent = BufferPool::TraceEvent;
+	using TraceRecord = BufferPool::TraceRecord;
+	using TraceHook = BufferPool::TraceHook;
+
+public: // methods
+	static void initialize(BinLayout layout = BinLayout::None, double spacing = 1.25) { pool().initialize(layout, spacing); }
+	static void initialize(const std::vector<uint32_t>& size_classes) { pool().initialize(size_classes); }
+	static uint32_t size_class(uint32_t min_size) { return pool().size_class(min_size); }
+
+	static void set_cleanup_timeout(time_t seconds = 0) { pool().set_cleanup_timeout(seconds); }
+	static void start_reclaimer(uint32_t interval_ms = 1000, size_t high_watermark = 0, size_t batch_size = 64) { pool().start_reclaimer(interval_ms, high_watermark, batch_size); }
+	static void stop_reclaimer() { pool().stop_reclaimer(); }
+	static void set_clock_resolution(uint32_t seconds) { pool().set_clock_resolution(seconds); }
+	static size_t bytes_pooled() { return pool().bytes_pooled(); }
+
+	static bool policy_is_active(Policy policy) { return pool().policy_is_active(policy); }
+	static void set_policy(Policy policy) { pool().set_policy(policy); }
+	static void set_policy(std::initializer_list<Policy> policies) { pool().set_policy(policies); }
+	static void clear_policy(Policy policy) { pool().clear_policy(policy); }
+
+	static size_t buffers_in_use() { return pool().buffers_in_use(); }
+	static size_t buffers_available() { return pool().buffers_available(); }
+	static void set_thread_cache_capacity(size_t buffers) { pool().set_thread_cache_capacity(buffers); }
+	static void flush_thread_cache() { pool().flush_thread_cache(); }
+	static CacheStatistics cache_statistics() { return pool().cache_statistics(); }
+	static void set_max_slack(uint32_t percent = 0) { pool().set_max_slack(percent); }
+	static void set_capacity(size_t max_bytes = 0, size_t max_class_buffers = 0) { pool().set_capacity(max_bytes, max_class_buffers); }
+	static FragmentationStatistics fragmentation_statistics() { return pool().fragmentation_statistics(); }
+	static PoolStatistics snapshot_stats() { return pool().snapshot_stats(); }
+
+	static bool register_fixed_pool(uint32_t size, uint32_t count) { return pool().register_fixed_pool(size, count); }
+	static bool reserve(const std::vector<Reservation>& reservations, bool prefault = false) { return pool().reserve(reservations, prefault); }
+	static std::vector<Reservation> reservation_profile() { return pool().reservation_profile(); }
+	static bool save_reservation_profile(const std::string& path) { return pool().save_reservation_profile(path); }
+	static bool load_reservation_profile(const std::string& path, bool prefault = false) { return pool().load_reservation_profile(path, prefault); }
+	static void set_arena(size_t slab_size = 64 * 1024 * 1024, bool huge_pages = false) { pool().set_arena(slab_size, huge_pages); }
+	static bool map_arena(const std::string& path, size_t size = 256 * 1024 * 1024) { return pool().map_arena(path, size); }
+	static int64_t mapped_offset(const BufferPtr& buffer) { return pool().mapped_offset(buffer); }
+	static void set_alignment(size_t alignment) { pool().set_alignment(alignment); }
+	static void reset() { pool().reset(); }
+
+	static BufferPtr single_buffer(uint32_t min_size) { return pool().single_buffer(min_size); }
+	static BufferPtr single_buffer(uint32_t min_size, const tracking_data_t& caller) { return pool().single_buffer(min_size, caller); }
+	static void acquire_buffers(const std::vector<uint32_t>& sizes, std::vector<BufferPtr>& buffers) { pool().acquire_buffers(sizes, buffers); }
+	static void acquire_buffers(const std::vector<uint32_t>& sizes, std::vector<BufferPtr>& buffers, const tracking_data_t& caller) { pool().acquire_buffers(sizes, buffers, caller); }
+	static BufferPtr single_buffer_from(const uint8_t* data, uint32_t size) { return pool().single_buffer_from(data, size); }
+	static BufferPtr single_buffer_from(const uint8_t* data, uint32_t size, const tracking_data_t& caller) { return pool().single_buffer_from(data, size, caller); }
+	static BufferPtr single_buffer_from(const char* data, size_t size) { return pool().single_buffer_from(data, size); }
+	static BufferPtr single_buffer_from(const char* data, size_t size, const tracking_data_t& caller) { return pool().single_buffer_from(data, size, caller); }
+	static BufferPtr single_buffer_from(const std::string& data) { return pool().single_buffer_from(data); }
+	static BufferPtr single_buffer_from(const std::string& data, const tracking_data_t& caller) { return pool().single_buffer_from(data, caller); }
+	static ScopedBuffer scoped_buffer(uint32_t min_size) { return pool().scoped_buffer(min_size); }
+	template <uint32_t N>
+	static BufferPtr single_buffer() { return pool().single_buffer<N>(); }
+	template <uint32_t N>
+	static BufferPtr single_buffer_from(const uint8_t* data) { return pool().single_buffer_from<N>(data); }
+	static BufferHandle buffer_handle(uint32_t min_size) { return pool().buffer_handle(min_size); }
+	static BufferChain acquire_chain(const std::vector<uint32_t>& sizes) { return pool().acquire_chain(sizes); }
+	static BufferPtr try_single_buffer(uint32_t min_size) { return pool().try_single_buffer(min_size); }
+	static BufferPtr single_buffer_wait(uint32_t min_size, std::chrono::milliseconds timeout) { return pool().single_buffer_wait(min_size, timeout); }
+	static void single_buffer_async(uint32_t min_size, AcquireCallback callback) { pool().single_buffer_async(min_size, std::move(callback)); }
+#if defined(__cpp_impl_coroutine)
+	static BufferPool::AcquireAwaitable acquire_async(uint32_t min_size) { return pool().acquire_async(min_size); }
+#endif
+	static bool resize_buffer(BufferPtr& buffer, uint32_t new_size) { return pool().resize_buffer(buffer, new_size); }
+
+	static bool buffer_in_use(const BufferPtr& buffer) { return pool().buffer_in_use(buffer); }
+	static bool release_buffer(const BufferPtr& buffer) { return pool().release_buffer(buffer); }
+	static bool release_buffer(const BufferPtr& buffer, const tracking_data_t& caller) { return pool().release_buffer(buffer, caller); }
+	static bool release_buffers(const std::vector<BufferPtr>& buffers) { return pool().release_buffers(buffers); }
+	static bool release_buffers(const std::vector<BufferPtr>& buffers, const tracking_data_t& caller) { return pool().release_buffers(buffers, caller); }
+
+	static void set_tracking_sample_rate(uint32_t one_in) { BufferPool::set_tracking_sample_rate(one_in); }
+	static void report_tracking() { pool().report_tracking(); }
+	static void set_trace_hook(TraceHook hook, void* context = nullptr) { pool().set_trace_hook(hook, context); }
+
+private: // methods
+	static BufferPool& pool() { return BufferPool::default_pool(); }
 };
@@ -2,58 +2,105 @@
 
 #include <array>
 #include <iostream>
+#include <iomanip>
 #include <cassert>
 #include <random>
 #include <numeric>
 #include <functional>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdlib>
+#include <future>
+#include <cstring>
+#include <sstream>
+#include <cstdio>
+#include <fstream>
 
 #include "PersistentBuffer.h"
 
 const std::vector<int> max_buffers = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
 
-std::string random_string()
+// the generator is passed in; seeding a fresh one from std::random_device on
+// every call would cost more than the pool operations being measured
+std::string random_string(std::mt19937& generator)
 {
 	std::string str("0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz");
 
-	std::random_device rd;
-	std::mt19937 generator(rd());
-
 	std::shuffle(str.begin(), str.end(), generator);
 
 	return str;
 	//return str.substr(0, 32); // assumes 32 < number of characters in str
 }
 
-double run_single_buffer_test(std::size_t max_data_size, int iterations = -1)
+// a ring of random buffer sizes between 1 and max_data_size, drawn before the
+// clock starts
+std::vector<uint32_t> random_sizes(std::mt19937& generator, std::size_t max_data_size, std::size_t count = 4096)
 {
-	double total_time{0.0};
+	std::uniform_int_distribution<> buf(1, static_cast<int>(max_data_size));
+
+	std::vector<uint32_t> sizes(count);
+	for (auto& size : sizes)
+		size = buf(generator);
+	return sizes;
+}
 
+// the loop is timed as a whole; reading the clock around each operation
+// would cost about as much as the operation itself
+double run_single_buffer_test(std::size_t max_data_size, int iterations = -1)
+{
 	std::random_device rd;
 	std::mt19937 rd_mt(rd());
 
-	// generate a random buffer size between 1 and max_data_size
-	std::uniform_int_distribution<> buf(1, static_cast<int>(max_data_size));
+	auto sizes = random_sizes(rd_mt, max_data_size);
+	std::size_t next{0};
 
+	auto start = std::chrono::steady_clock::now();
 	while (iterations)
 	{
-		auto start = std::chrono::steady_clock::now();
-		auto buffer = PersistentBuffer::single_buffer(buf(rd_mt));
-		auto diff = std::chrono::steady_clock::now() - start;
-		total_time += std::chrono::duration<double, std::milli>(diff).count();
+		auto buffer = PersistentBuffer::single_buffer(sizes[next++ % sizes.size()]);
+		PersistentBuffer::release_buffer(buffer);
+
+		if (iterations != -1)
+			--iterations;
+	}
+	auto diff = std::chrono::steady_clock::now() - start;
+
+	return std::chrono::duration<double, std::milli>(diff).count();
+}
+
+double run_single_buffer_from_test(int iterations = -1)
+{
+	std::random_device rd;
+	std::mt19937 rd_mt(rd());
+
+	// a ring of shuffled strings, prepared before the clock starts
+	std::vector<std::string> strings(256);
+	for (auto& s : strings)
+		s = random_string(rd_mt);
+	std::size_t next{0};
 
-		start = std::chrono::steady_clock::now();
+	auto start = std::chrono::steady_clock::now();
+	while (iterations)
+	{
+		const auto& s = strings[next++ % strings.size()];
+		auto buffer = PersistentBuffer::single_buffer_from(s.c_str(), s.length());
 		PersistentBuffer::release_buffer(buffer);
-		diff = std::chrono::steady_clock::now() - start;
-		total_time += std::chrono::duration<double, std::milli>(diff).count();
 
 		if (iterations != -1)
 			--iterations;
 	}
+	auto diff = std::chrono::steady_clock::now() - start;
 
-	return total_time;
+	return std::chrono::duration<double, std::milli>(diff).count();
 }
 
-double run_single_buffer_from_test(std::size_t max_data_size, int iterations = -1)
+double run_release_buffers_test(std::size_t max_data_size, int iterations = -1)
 {
 	double total_time{0.0};
 
@@ -63,20 +110,19 @@ double run_single_buffer_from_test(std::size_t max_data_size, int iterations = -
 	// generate a random buffer size between 1 and max_data_size
 	std::uniform_int_distribution<> buf(1, static_cast<int>(max_data_size));
 
+	std::vector<PersistentBuffer::BufferPtr> buffers;
+	buffers.resize(max_buffers.size());
+
 	while (iterations)
 	{
-		std::string s = std::move(random_string());
+		for (auto i : max_buffers)
+			buffers[i] = PersistentBuffer::single_buffer(buf(rd_mt));
 
 		auto start = std::chrono::steady_clock::now();
-		auto buffer = PersistentBuffer::single_buffer_from(s.c_str(), s.length());
+		PersistentBuffer::release_buffers(buffers);
 		auto diff = std::chrono::steady_clock::now() - start;
 		total_time += std::chrono::duration<double, std::milli>(diff).count();
 
-		start = std::chrono::steady_clock::now();
-		PersistentBuffer::release_buffer(buffer);
-		diff = std::chrono::steady_clock::now() - start;
-		total_time += std::chrono::duration<double, std::milli>(diff).count();
-
 		if (iterations != -1)
 			--iterations;
 	}
@@ -84,7 +130,7 @@ double run_single_buffer_from_test(std::size_t max_data_size, int iterations = -
 	return total_time;
 }
 
-double run_release_buffers_test(std::size_t max_data_size, int iterations = -1)
+double run_acquire_buffers_test(std::size_t max_data_size, int iterations = -1)
 {
 	double total_time{0.0};
 
@@ -94,21 +140,21 @@ double run_release_buffers_test(std::size_t max_data_size, int iterations = -1)
 	// generate a random buffer size between 1 and max_data_size
 	std::uniform_int_distribution<> buf(1, static_cast<int>(max_data_size));
 
+	std::vector<uint32_t> sizes(max_buffers.size());
 	std::vector<PersistentBuffer::BufferPtr> buffers;
-	buffers.resize(max_buffers.size());
 
 	while (iterations)
 	{
-		std::string s = std::move(random_string());
-
 		for (auto i : max_buffers)
-			buffers[i] = PersistentBuffer::single_buffer(buf(rd_mt));
+			sizes[i] = buf(rd_mt);
 
 		auto start = std::chrono::steady_clock::now();
-		PersistentBuffer::release_buffers(buffers);
+		PersistentBuffer::acquire_buffers(sizes, buffers);
 		auto diff = std::chrono::steady_clock::now() - start;
 		total_time += std::chrono::duration<double, std::milli>(diff).count();
 
+		PersistentBuffer::release_buffers(buffers);
+
 		if (iterations != -1)
 			--iterations;
 	}
@@ -116,34 +162,1895 @@ double run_release_buffers_test(std::size_t max_data_size, int iterations = -1)
 	return total_time;
 }
 
-int main(int argc, char* argv[])
+// measures acquisitions that must allocate a new buffer (pool misses) separately
+// from acquisitions that re-use one.  every buffer is held until the pass ends,
+// so the first pass can only miss and the second pass can only reuse.
+void run_miss_path_test(std::size_t max_data_size, int count, double& miss_ns, double& reuse_ns)
+{
+	std::random_device rd;
+	std::mt19937 rd_mt(rd());
+
+	// generate a random buffer size between 1 and max_data_size
+	std::uniform_int_distribution<> buf(1, static_cast<int>(max_data_size));
+
+	std::vector<uint32_t> sizes(count);
+	for (auto& size : sizes)
+		size = buf(rd_mt);
+
+	std::vector<PersistentBuffer::BufferPtr> buffers(count);
+
+	PersistentBuffer::reset();
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; ++i)
+		buffers[i] = PersistentBuffer::single_buffer(sizes[i]);
+	auto diff = std::chrono::steady_clock::now() - start;
+	miss_ns = std::chrono::duration<double, std::nano>(diff).count() / count;
+
+	PersistentBuffer::release_buffers(buffers);
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; ++i)
+		buffers[i] = PersistentBuffer::single_buffer(sizes[i]);
+	diff = std::chrono::steady_clock::now() - start;
+	reuse_ns = std::chrono::duration<double, std::nano>(diff).count() / count;
+
+	PersistentBuffer::release_buffers(buffers);
+}
+
+// runs the miss-path test with exact-size buffers, and again with power-of-two
+// size classes
+void report_miss_path_test()
+{
+	double miss_ns{0.0}, reuse_ns{0.0};
+
+	PersistentBuffer::initialize(PersistentBuffer::BinLayout::None);
+	run_miss_path_test(16384, 20000, miss_ns, reuse_ns);
+	std::cout << "   miss path (exact): " << miss_ns << " ns/acquisition" << std::endl;
+	std::cout << "  reuse path (exact): " << reuse_ns << " ns/acquisition" << std::endl;
+
+	PersistentBuffer::initialize(PersistentBuffer::BinLayout::PowerOfTwo);
+	run_miss_path_test(16384, 20000, miss_ns, reuse_ns);
+	std::cout << "  miss path (binned): " << miss_ns << " ns/acquisition" << std::endl;
+	std::cout << " reuse path (binned): " << reuse_ns << " ns/acquisition" << std::endl;
+
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize(PersistentBuffer::BinLayout::None);
+}
+
+// measures a steady acquire/release cycle over a small working set of 'size'
+// byte buffers, so every acquisition after the first lap re-uses one
+double run_zero_test(uint32_t size, int iterations)
+{
+	std::vector<PersistentBuffer::BufferPtr> buffers(16);
+	for (auto& buffer : buffers)
+		buffer = PersistentBuffer::single_buffer(size);
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i)
+	{
+		auto& buffer = buffers[i % buffers.size()];
+		PersistentBuffer::release_buffer(buffer);
+		buffer = PersistentBuffer::single_buffer(size);
+	}
+	auto diff = std::chrono::steady_clock::now() - start;
+
+	PersistentBuffer::release_buffers(buffers);
+	return std::chrono::duration<double, std::nano>(diff).count() / iterations;
+}
+
+// runs the zeroing test at a few sizes, with 'ZeroBuffer' off, zeroing as
+// buffers are re-used, zeroing as they are released, and zeroing on release
+// left to the background reclaimer
+void report_zero_test()
+{
+	const char* modes[] = {"off", "on acquire", "on release", "reclaimer"};
+
+	for (uint32_t size : {4096u, 65536u, 1048576u})
+	{
+		// about 1GiB of buffers handed out per mode
+		auto iterations = static_cast<int>((1024u * 1024 * 1024) / size);
+
+		std::cout << std::setw(8) << size << " bytes:";
+		for (int mode = 0; mode < 4; ++mode)
+		{
+			PersistentBuffer::reset();
+			PersistentBuffer::initialize(PersistentBuffer::BinLayout::PowerOfTwo);
+			if (mode == 0)
+				PersistentBuffer::clear_policy(PersistentBuffer::ZeroBuffer);
+			if (mode >= 2)
+				PersistentBuffer::set_policy(PersistentBuffer::ZeroOnRelease);
+			if (mode == 3)
+				PersistentBuffer::start_reclaimer();
+
+			std::cout << "  " << modes[mode] << " " << run_zero_test(size, iterations) << " ns";
+
+			PersistentBuffer::stop_reclaimer();
+		}
+		std::cout << std::endl;
+	}
+
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize(PersistentBuffer::BinLayout::None);
+}
+
+// --- benchmark suite ("bench") ----------------------------------------------
+//
+// each scenario runs the same workload against the pool and against plain
+// new[]/delete[] and malloc()/free(), across a number of threads.  throughput
+// covers every operation; latency is taken from one operation in every
+// 'sample_interval', so the clock reads stay out of most of what is measured
+
+// a source of buffer sizes for the benchmark workloads
+enum class SizeDistribution
+{
+	Uniform,	// evenly spread between 1 and 16KiB
+	LogNormal,	// mostly small, with a long tail (median 512 bytes, capped at 64KiB)
+	FixedSet,	// a handful of protocol-like sizes
+};
+
+const char* distribution_name(SizeDistribution distribution)
+{
+	switch (distribution)
+	{
+		case SizeDistribution::Uniform: return "uniform";
+		case SizeDistribution::LogNormal: return "log-normal";
+		case SizeDistribution::FixedSet: return "fixed-set";
+	}
+	return "";
+}
+
+// a ring of sizes drawn from 'distribution', prepared before the clock starts.
+// each thread reads it from a different offset
+std::vector<uint32_t> distribution_sizes(SizeDistribution distribution, std::size_t count = 65536)
+{
+	std::mt19937 generator(12345); // fixed, so every allocator sees the same sizes
+	std::vector<uint32_t> sizes(count);
+
+	switch (distribution)
+	{
+		case SizeDistribution::Uniform:
+		{
+			std::uniform_int_distribution<uint32_t> uniform(1, 16384);
+			for (auto& size : sizes)
+				size = uniform(generator);
+			break;
+		}
+		case SizeDistribution::LogNormal:
+		{
+			std::lognormal_distribution<double> lognormal(std::log(512.0), 1.5);
+			for (auto& size : sizes)
+				size = static_cast<uint32_t>(std::min(std::max(lognormal(generator), 1.0), 65536.0));
+			break;
+		}
+		case SizeDistribution::FixedSet:
+		{
+			const uint32_t fixed[] = {64, 256, 576, 1500, 4096, 9000};
+			std::uniform_int_distribution<std::size_t> pick(0, std::size(fixed) - 1);
+			for (auto& size : sizes)
+				size = fixed[pick(generator)];
+			break;
+		}
+	}
+
+	return sizes;
+}
+
+// the allocators under test.  each hands out a handle, and can write to the
+// storage behind it so that the pages are really touched
+struct PoolAllocator
+{
+	using handle_t = BufferPool::BufferPtr;
+
+	PoolAllocator(BufferPool::BinLayout layout, bool collect, bool thread_cache = false)
+	{
+		pool.initialize(layout);
+		pool.clear_policy(BufferPool::ZeroBuffer);
+		if (thread_cache)
+			pool.set_policy(BufferPool::ThreadCache);
+		if (collect)
+		{
+			// age out anything idle for a second, and keep the pool under
+			// 64MiB from the reclaimer thread
+			pool.set_cleanup_timeout(1);
+			pool.start_reclaimer(10, 64 * 1024 * 1024);
+		}
+	}
+	~PoolAllocator() { pool.stop_reclaimer(); }
+
+	handle_t acquire(uint32_t size) { return pool.single_buffer(size); }
+	void release(handle_t& handle) { pool.release_buffer(handle); handle.reset(); }
+	static uint8_t* data(const handle_t& handle) { return handle->rw(); }
+
+	BufferPool pool;
+};
+
+struct NewAllocator
+{
+	using handle_t = uint8_t*;
+
+	handle_t acquire(uint32_t size) { return new uint8_t[size]; }
+	void release(handle_t& handle) { delete[] handle; handle = nullptr; }
+	static uint8_t* data(handle_t handle) { return handle; }
+};
+
+struct MallocAllocator
+{
+	using handle_t = uint8_t*;
+
+	handle_t acquire(uint32_t size) { return static_cast<uint8_t*>(malloc(size)); }
+	void release(handle_t& handle) { free(handle); handle = nullptr; }
+	static uint8_t* data(handle_t handle) { return handle; }
+};
+
+// what one benchmark thread did
+struct ThreadSamples
+{
+	uint64_t ops{0};
+	std::vector<uint32_t> latency_ns;
+};
+
+struct BenchResult
+{
+	double mops{0.0};	// millions of operations per second, all threads
+	uint32_t p50{0};
+	uint32_t p99{0};
+	uint32_t p999{0};
+};
+
+static constexpr uint64_t sample_interval{16};
+
+// runs 'op', timing it if it is due to be sampled
+template <typename Op>
+inline void sampled(ThreadSamples& samples, Op&& op)
+{
+	if ((samples.ops++ % sample_interval) != 0)
+	{
+		op();
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	op();
+	auto diff = std::chrono::steady_clock::now() - start;
+	samples.latency_ns.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(diff).count()));
+}
+
+// starts 'threads' threads together on 'body(thread_index, samples)', and
+// reports the throughput and latency percentiles of the operations they ran
+template <typename Body>
+BenchResult run_threads(int threads, Body&& body)
 {
+	std::vector<ThreadSamples> samples(threads);
+	std::vector<std::thread> workers;
+	std::atomic<int> ready{0};
+	std::atomic<bool> go{false};
+
+	for (int t = 0; t < threads; ++t)
+	{
+		workers.emplace_back([&, t] {
+			ready.fetch_add(1);
+			while (!go.load(std::memory_order_acquire))
+				std::this_thread::yield();
+			body(t, samples[t]);
+		});
+	}
+
+	while (ready.load() < threads)
+		std::this_thread::yield();
+
+	auto start = std::chrono::steady_clock::now();
+	go.store(true, std::memory_order_release);
+	for (auto& worker : workers)
+		worker.join();
+	auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	uint64_t ops{0};
+	std::vector<uint32_t> latency_ns;
+	for (auto& thread : samples)
+	{
+		ops += thread.ops;
+		latency_ns.insert(latency_ns.end(), thread.latency_ns.begin(), thread.latency_ns.end());
+	}
+	std::sort(latency_ns.begin(), latency_ns.end());
+
+	auto percentile = [&](double q) {
+		if (latency_ns.empty())
+			return uint32_t{0};
+		return latency_ns[std::min(latency_ns.size() - 1, static_cast<std::size_t>(q * latency_ns.size()))];
+	};
+
+	BenchResult result;
+	result.mops = ops / seconds / 1e6;
+	result.p50 = percentile(0.50);
+	result.p99 = percentile(0.99);
+	result.p999 = percentile(0.999);
+	return result;
+}
+
+// every thread cycles a small working set of buffers: release the oldest,
+// acquire a replacement, and write to it
+template <typename Allocator>
+BenchResult run_contended_bench(Allocator& allocator, const std::vector<uint32_t>& sizes, int threads, int ops_per_thread)
+{
+	return run_threads(threads, [&](int t, ThreadSamples& samples) {
+		const std::size_t working_set{8};
+		std::size_t next{static_cast<std::size_t>(t) * 7919};
+
+		std::vector<typename Allocator::handle_t> held(working_set);
+		for (auto& handle : held)
+			handle = allocator.acquire(sizes[next++ % sizes.size()]);
+
+		for (int i = 0; i < ops_per_thread / 2; ++i)
+		{
+			auto& handle = held[i % working_set];
+			auto size = sizes[next++ % sizes.size()];
+
+			sampled(samples, [&] { allocator.release(handle); });
+			sampled(samples, [&] { handle = allocator.acquire(size); });
+			Allocator::data(handle)[0] = static_cast<uint8_t>(i);
+		}
+
+		for (auto& handle : held)
+			allocator.release(handle);
+	});
+}
+
+// a single-producer, single-consumer ring for handing buffers between threads
+template <typename T>
+class HandoffRing
+{
+public:
+	explicit HandoffRing(std::size_t capacity) : m_slots(capacity) {}
+
+	bool push(T& value)
+	{
+		auto tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) == m_slots.size())
+			return false;
+		m_slots[tail % m_slots.size()] = std::move(value);
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& value)
+	{
+		auto head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire))
+			return false;
+		value = std::move(m_slots[head % m_slots.size()]);
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	std::vector<T> m_slots;
+	alignas(64) std::atomic<std::size_t> m_head{0};
+	alignas(64) std::atomic<std::size_t> m_tail{0};
+};
+
+// half the threads acquire and fill buffers, and hand them to the other half,
+// which release them; every buffer is released on a thread other than the
+// one that acquired it
+template <typename Allocator>
+BenchResult run_producer_consumer_bench(Allocator& allocator, const std::vector<uint32_t>& sizes, int threads, int ops_per_thread)
+{
+	using handle_t = typename Allocator::handle_t;
+
+	const int pairs{std::max(threads / 2, 1)};
+	std::vector<std::unique_ptr<HandoffRing<handle_t>>> rings;
+	for (int p = 0; p < pairs; ++p)
+		rings.emplace_back(new HandoffRing<handle_t>(256));
+
+	return run_threads(pairs * 2, [&](int t, ThreadSamples& samples) {
+		auto& ring = *rings[t % pairs];
+
+		if (t < pairs)
+		{
+			std::size_t next{static_cast<std::size_t>(t) * 7919};
+			for (int i = 0; i < ops_per_thread; ++i)
+			{
+				handle_t handle;
+				auto size = sizes[next++ % sizes.size()];
+				sampled(samples, [&] { handle = allocator.acquire(size); });
+				Allocator::data(handle)[0] = static_cast<uint8_t>(i);
+				while (!ring.push(handle))
+					std::this_thread::yield();
+			}
+		}
+		else
+		{
+			for (int i = 0; i < ops_per_thread; ++i)
+			{
+				handle_t handle;
+				while (!ring.pop(handle))
+					std::this_thread::yield();
+				sampled(samples, [&] { allocator.release(handle); });
+			}
+		}
+	});
+}
+
+// every thread fills a large working set from an empty allocator, so almost
+// every acquisition misses the pool, then releases it all
+template <typename Allocator>
+BenchResult run_warm_up_bench(Allocator& allocator, const std::vector<uint32_t>& sizes, int threads, int ops_per_thread)
+{
+	return run_threads(threads, [&](int t, ThreadSamples& samples) {
+		std::size_t next{static_cast<std::size_t>(t) * 7919};
+
+		std::vector<typename Allocator::handle_t> held(std::min(ops_per_thread / 2, 4096));
+		for (auto& handle : held)
+		{
+			auto size = sizes[next++ % sizes.size()];
+			sampled(samples, [&] { handle = allocator.acquire(size); });
+			Allocator::data(handle)[0] = 1;
+		}
+
+		for (auto& handle : held)
+			sampled(samples, [&] { allocator.release(handle); });
+	});
+}
+
+enum class BenchScenario
+{
+	Contended,
+	ProducerConsumer,
+	WarmUp,
+	Collecting,	// 'Contended' with age-based collection and the reclaimer running
+};
+
+const char* scenario_name(BenchScenario scenario)
+{
+	switch (scenario)
+	{
+		case BenchScenario::Contended: return "contended acquire/release";
+		case BenchScenario::ProducerConsumer: return "producer/consumer (cross-thread release)";
+		case BenchScenario::WarmUp: return "miss-heavy warm-up";
+		case BenchScenario::Collecting: return "contended, with garbage collection";
+	}
+	return "";
+}
+
+template <typename Allocator>
+BenchResult run_bench(BenchScenario scenario, Allocator& allocator, const std::vector<uint32_t>& sizes, int threads, int ops_per_thread)
+{
+	switch (scenario)
+	{
+		case BenchScenario::ProducerConsumer: return run_producer_consumer_bench(allocator, sizes, threads, ops_per_thread);
+		case BenchScenario::WarmUp: return run_warm_up_bench(allocator, sizes, threads, ops_per_thread);
+		default: return run_contended_bench(allocator, sizes, threads, ops_per_thread);
+	}
+}
+
+void print_bench_result(const char* name, const BenchResult& result)
+{
+	std::cout << std::setw(22) << name << ": "
+			  << std::fixed << std::setprecision(2) << std::setw(8) << result.mops << " Mops/s"
+			  << "  p50 " << std::setw(6) << result.p50 << " ns"
+			  << "  p99 " << std::setw(6) << result.p99 << " ns"
+			  << "  p999 " << std::setw(7) << result.p999 << " ns" << std::endl;
+	std::cout.unsetf(std::ios::fixed);
+}
+
+// runs every scenario with every size distribution, against the pool (exact
+// sizes, power-of-two classes, and classes with the thread-cache tier) and
+// the heap baselines
+void report_bench(int threads, int ops_per_thread)
+{
+	std::cout << threads << " threads, " << ops_per_thread << " operations per thread; "
+			  << "latency sampled from 1 in " << sample_interval << " operations" << std::endl;
+
+	for (auto scenario : {BenchScenario::Contended, BenchScenario::ProducerConsumer, BenchScenario::WarmUp, BenchScenario::Collecting})
+	{
+		const bool collect{scenario == BenchScenario::Collecting};
+
+		for (auto distribution : {SizeDistribution::Uniform, SizeDistribution::LogNormal, SizeDistribution::FixedSet})
+		{
+			auto sizes = distribution_sizes(distribution);
+
+			std::cout << std::endl << scenario_name(scenario) << ", " << distribution_name(distribution) << " sizes" << std::endl;
+
+			{
+				PoolAllocator allocator(BufferPool::BinLayout::None, collect);
+				print_bench_result("pool (exact)", run_bench(scenario, allocator, sizes, threads, ops_per_thread));
+			}
+			{
+				PoolAllocator allocator(BufferPool::BinLayout::PowerOfTwo, collect);
+				print_bench_result("pool (binned)", run_bench(scenario, allocator, sizes, threads, ops_per_thread));
+			}
+			{
+				PoolAllocator allocator(BufferPool::BinLayout::PowerOfTwo, collect, true);
+				print_bench_result("pool (thread cache)", run_bench(scenario, allocator, sizes, threads, ops_per_thread));
+			}
+
+			// collection changes nothing for the baselines
+			if (collect)
+				continue;
+
+			{
+				NewAllocator allocator;
+				print_bench_result("new[]/delete[]", run_bench(scenario, allocator, sizes, threads, ops_per_thread));
+			}
+			{
+				MallocAllocator allocator;
+				print_bench_result("malloc()/free()", run_bench(scenario, allocator, sizes, threads, ops_per_thread));
+			}
+		}
+	}
+}
+
+// --- correctness checks ("check") ------------------------------------------
+//
+// each check reports what went wrong and returns false on failure
+
+// with the thread-cache tier, a buffer released on a thread is handed back to
+// that thread without the shared pool, and one released on another thread
+// returns to the shared pool when that thread exits
+bool check_thread_cache()
+{
+	PersistentBuffer::reset();
 	PersistentBuffer::initialize();
+	PersistentBuffer::set_policy(PersistentBuffer::ThreadCache);
 
-	// set an upper size for any given buffer size requirement
-	auto max = 500000;
+	bool ok{true};
+	auto buffer = PersistentBuffer::single_buffer(100);
+	auto* first = buffer.get();
+	PersistentBuffer::release_buffer(buffer);
+	auto hits = PersistentBuffer::cache_statistics().local_hits;
+	buffer = PersistentBuffer::single_buffer(100);
+	if (buffer.get() != first || PersistentBuffer::cache_statistics().local_hits != hits + 1)
+	{
+		std::cout << "thread cache: a released buffer was not re-used from the cache" << std::endl;
+		ok = false;
+	}
 
-	// number of iterations
-	auto iter = 1000000;
+	std::thread([&buffer] { PersistentBuffer::release_buffer(buffer); }).join();
+	buffer = PersistentBuffer::single_buffer(100);
+	if (buffer.get() != first)
+	{
+		std::cout << "thread cache: a buffer released on an exited thread was lost" << std::endl;
+		ok = false;
+	}
+	PersistentBuffer::release_buffer(buffer);
+	return ok;
+}
 
-	// test the speed of the single_buffer() method that will allocate (or reuse)
-	// a single buffer
-	auto millis = run_single_buffer_test(max, iter);
-	std::cout << "     single_buffer(): " << millis << " ms" << std::endl;
+// a batch that takes the lock for a shared-pool buffer, then releases a
+// cached one on a thread that has no cache yet, must not deadlock
+bool check_batch_release_without_cache()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
 
-	// test the speed of the single_buffer_from() method that will allocate (or reuse)
-	// a buffer and the populated with the provided data
-	millis = run_single_buffer_from_test(max, iter);
-	std::cout << "single_buffer_from(): " << millis << " ms" << std::endl;
+	std::vector<PersistentBuffer::BufferPtr> buffers{PersistentBuffer::single_buffer(100)};
+	PersistentBuffer::set_policy(PersistentBuffer::ThreadCache);
+	std::thread([&buffers] { buffers.push_back(PersistentBuffer::single_buffer(100)); }).join();
 
-	// test the speed of just the release_buffers() method where multiple buffers are
-	// returned at the same time
-	millis = run_release_buffers_test(max, iter);
-	std::cout << "   release_buffers(): " << millis << " ms" << std::endl;
+	std::promise<void> released;
+	auto done = released.get_future();
+	std::thread([&buffers, &released] {
+		PersistentBuffer::release_buffers(buffers);
+		released.set_value();
+	}).detach();
+	if (done.wait_for(std::chrono::seconds(10)) != std::future_status::ready)
+	{
+		// the thread cannot be recovered; leave it to the process exit
+		std::cout << "batch release: deadlocked releasing to a new thread cache" << std::endl;
+		std::cout << "checks failed" << std::endl;
+		std::_Exit(1);
+	}
+	return true;
+}
 
-	std::cout << std::endl
-			  << PersistentBuffer::buffers_available() << " buffers were allocated out of "
-			  << (iter /*run_single_buffer_test()*/ + iter /*run_single_buffer_from_test*/ +
-				  (iter * max_buffers.size()) /**run_release_buffers_test*/)
-			  << " buffer requests." << std::endl;
+// requests in the same size class share buffers, and explicit classes round
+// up to the next class or not at all
+bool check_size_classes()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize(PersistentBuffer::BinLayout::PowerOfTwo);
+
+	bool ok{true};
+	if (PersistentBuffer::size_class(100) != 128 || PersistentBuffer::size_class(1000) != 1024)
+	{
+		std::cout << "size classes: power-of-two classes are wrong" << std::endl;
+		ok = false;
+	}
+	auto buffer = PersistentBuffer::single_buffer(100);
+	auto* first = buffer.get();
+	PersistentBuffer::release_buffer(buffer);
+	buffer = PersistentBuffer::single_buffer(120);
+	if (buffer.get() != first)
+	{
+		std::cout << "size classes: a free buffer of the class was not re-used" << std::endl;
+		ok = false;
+	}
+	PersistentBuffer::release_buffer(buffer);
+
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize(std::vector<uint32_t>{64, 256});
+	if (PersistentBuffer::size_class(65) != 256 || PersistentBuffer::size_class(300) != 300)
+	{
+		std::cout << "size classes: explicit classes are wrong" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+// buffers allocated out of size order are still found by best fit
+bool check_size_index()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize(PersistentBuffer::BinLayout::None);
+
+	std::vector<PersistentBuffer::BufferPtr> buffers;
+	for (uint32_t size : {300u, 100u, 200u})
+		buffers.push_back(PersistentBuffer::single_buffer(size));
+	auto* middle = buffers[2].get();
+	auto* largest = buffers[0].get();
+	PersistentBuffer::release_buffers(buffers);
+
+	bool ok{true};
+	auto fit = PersistentBuffer::single_buffer(150);
+	auto next = PersistentBuffer::single_buffer(250);
+	if (fit.get() != middle || next.get() != largest)
+	{
+		std::cout << "size index: a free buffer was not found by best fit" << std::endl;
+		ok = false;
+	}
+	if (PersistentBuffer::buffers_available() != 3)
+	{
+		std::cout << "size index: " << PersistentBuffer::buffers_available() << " buffers, expected 3" << std::endl;
+		ok = false;
+	}
+	PersistentBuffer::release_buffer(fit);
+	PersistentBuffer::release_buffer(next);
+	return ok;
+}
+
+// a fixed pool serves its size until it runs out, then the general path
+// takes over; its buffers come back to it on release
+bool check_fixed_pool()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+
+	bool ok{true};
+	if (!PersistentBuffer::register_fixed_pool(64, 2) || PersistentBuffer::register_fixed_pool(64, 2))
+	{
+		std::cout << "fixed pool: registration was not accepted exactly once" << std::endl;
+		ok = false;
+	}
+
+	std::vector<PersistentBuffer::BufferPtr> buffers;
+	for (int i = 0; i < 3; ++i)
+		buffers.push_back(PersistentBuffer::single_buffer(64));
+	if (PersistentBuffer::buffers_available() != 3)
+	{
+		std::cout << "fixed pool: exhaustion did not fall back to one new buffer" << std::endl;
+		ok = false;
+	}
+
+	auto* fixed = buffers[0].get();
+	PersistentBuffer::release_buffers(buffers);
+	auto buffer = PersistentBuffer::single_buffer(64);
+	if (buffer.get() != fixed && buffer.get() != buffers[1].get())
+	{
+		std::cout << "fixed pool: a released buffer did not return to the pool" << std::endl;
+		ok = false;
+	}
+	PersistentBuffer::release_buffer(buffer);
+	return ok;
+}
+
+// in 'Arena' mode, buffers are carved one after another from a slab, and a
+// request larger than half a slab gets one of its own
+bool check_arena()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	PersistentBuffer::set_arena(1 << 20);
+
+	auto first = PersistentBuffer::single_buffer(1000);
+	auto second = PersistentBuffer::single_buffer(1000);
+	auto large = PersistentBuffer::single_buffer(600 * 1024);
+
+	bool ok{true};
+	auto distance = second->rw() - first->rw();
+	if (distance < 1000 || distance >= (1 << 20))
+	{
+		std::cout << "arena: buffers were not carved from the same slab" << std::endl;
+		ok = false;
+	}
+	auto offset = large->rw() - first->rw();
+	if (offset >= 0 && offset < (1 << 20))
+	{
+		std::cout << "arena: a large request was carved from a shared slab" << std::endl;
+		ok = false;
+	}
+	memset(large->rw(), 0xAB, large->size());
+
+	PersistentBuffer::release_buffer(first);
+	PersistentBuffer::release_buffer(second);
+	PersistentBuffer::release_buffer(large);
+	return ok;
+}
+
+// a handle keeps its buffer checked out until its last copy goes, and a
+// scoped owner releases its buffer when it is destroyed
+bool check_handles()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+
+	bool ok{true};
+	{
+		auto handle = PersistentBuffer::buffer_handle(100);
+		auto copy = handle;
+		handle.reset();
+		if (PersistentBuffer::buffers_in_use() != 1)
+		{
+			std::cout << "handles: a buffer was released while a copy remained" << std::endl;
+			ok = false;
+		}
+	}
+	if (PersistentBuffer::buffers_in_use() != 0)
+	{
+		std::cout << "handles: the last copy did not release its buffer" << std::endl;
+		ok = false;
+	}
+
+	{
+		auto scoped = PersistentBuffer::scoped_buffer(100);
+		auto moved = std::move(scoped);
+		if (scoped || !moved || PersistentBuffer::buffers_in_use() != 1)
+		{
+			std::cout << "handles: a scoped owner did not move" << std::endl;
+			ok = false;
+		}
+	}
+	if (PersistentBuffer::buffers_in_use() != 0)
+	{
+		std::cout << "handles: a scoped owner did not release its buffer" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+// every pooled buffer is registered once, whether free or in use, and reset()
+// empties the registry
+bool check_registry()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+
+	std::vector<PersistentBuffer::BufferPtr> buffers;
+	for (uint32_t size = 100; size <= 500; size += 100)
+		buffers.push_back(PersistentBuffer::single_buffer(size));
+	PersistentBuffer::release_buffers(buffers);
+	for (uint32_t size = 100; size <= 500; size += 100)
+		buffers.push_back(PersistentBuffer::single_buffer(size));
+
+	bool ok{true};
+	if (PersistentBuffer::buffers_available() != 5 || !PersistentBuffer::buffer_in_use(buffers.back()))
+	{
+		std::cout << "registry: re-used buffers were registered again" << std::endl;
+		ok = false;
+	}
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	if (PersistentBuffer::buffers_available() != 0 || PersistentBuffer::buffer_in_use(buffers.back()))
+	{
+		std::cout << "registry: reset() left buffers behind" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+// with 'DropOld', the next miss after the timeout drops the buffers that have
+// been idle for longer, and keeps those released since
+bool check_age_gc()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	PersistentBuffer::set_cleanup_timeout(1);
+
+	auto old_buffer = PersistentBuffer::single_buffer(100);
+	auto young_buffer = PersistentBuffer::single_buffer(200);
+	PersistentBuffer::release_buffer(old_buffer);
+	std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+	PersistentBuffer::release_buffer(young_buffer);
+	auto miss = PersistentBuffer::single_buffer(300);
+
+	bool ok{true};
+	if (PersistentBuffer::buffers_available() != 2)
+	{
+		std::cout << "age gc: " << PersistentBuffer::buffers_available() << " buffers left, expected 2" << std::endl;
+		ok = false;
+	}
+	auto reused = PersistentBuffer::single_buffer(200);
+	if (reused.get() != young_buffer.get())
+	{
+		std::cout << "age gc: a recently released buffer was dropped" << std::endl;
+		ok = false;
+	}
+	PersistentBuffer::release_buffer(miss);
+	PersistentBuffer::release_buffer(reused);
+	return ok;
+}
+
+// the reclaimer trims a pool that has gone over its high watermark back
+// under it, from the least recently used free buffers
+bool check_reclaimer()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	PersistentBuffer::start_reclaimer(10, 10000);
+
+	std::vector<PersistentBuffer::BufferPtr> buffers;
+	for (int i = 0; i < 10; ++i)
+		buffers.push_back(PersistentBuffer::single_buffer(2000));
+	PersistentBuffer::release_buffers(buffers);
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (PersistentBuffer::bytes_pooled() > 10000 && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	PersistentBuffer::stop_reclaimer();
+
+	if (PersistentBuffer::bytes_pooled() > 10000)
+	{
+		std::cout << "reclaimer: the pool was left at " << PersistentBuffer::bytes_pooled() << " bytes" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// release stamps from the coarse clock are never staler than its resolution,
+// and a batch is stamped alike
+bool check_coarse_clock()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	PersistentBuffer::set_clock_resolution(1);
+	PersistentBuffer::start_reclaimer(10);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	std::vector<PersistentBuffer::BufferPtr> buffers{PersistentBuffer::single_buffer(100), PersistentBuffer::single_buffer(200)};
+	PersistentBuffer::release_buffers(buffers);
+	auto now = time(nullptr);
+	PersistentBuffer::stop_reclaimer();
+	PersistentBuffer::set_clock_resolution(0);
+
+	auto stamp = buffers[0]->last_used();
+	if (stamp > now || now - stamp > 1 || buffers[1]->last_used() != stamp)
+	{
+		std::cout << "coarse clock: a release was stamped " << (now - stamp) << "s stale" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// 'ZeroBuffer' clears what the previous holder left in a re-used buffer,
+// and 'ZeroOnRelease' clears it as the buffer goes back
+bool check_zero_reuse()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	bool ok{true};
+
+	auto first = PersistentBuffer::single_buffer(4096);
+	memset(first->rw(), 0xab, 4096);
+	PersistentBuffer::release_buffer(first);
+	auto second = PersistentBuffer::single_buffer(4096);
+	if (second.get() != first.get() || std::count(second->ro(), second->ro() + 4096, 0) != 4096)
+	{
+		std::cout << "zeroing: a re-used buffer kept the previous holder's data" << std::endl;
+		ok = false;
+	}
+
+	// the storage is inspected through a kept pointer, as a released buffer
+	// cannot be read through its own accessors
+	PersistentBuffer::set_policy({PersistentBuffer::ZeroBuffer, PersistentBuffer::ZeroOnRelease});
+	const uint8_t* data{second->rw()};
+	memset(second->rw(), 0xcd, 4096);
+	PersistentBuffer::release_buffer(second);
+	if (std::count(data, data + 4096, 0) != 4096)
+	{
+		std::cout << "zeroing: 'ZeroOnRelease' left a released buffer dirty" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+// storage honors the alignment from heap and arena alike, and 'NumaAware'
+// still finds a released buffer again
+bool check_alignment_numa()
+{
+	bool ok{true};
+	for (bool arena : {false, true})
+	{
+		PersistentBuffer::reset();
+		PersistentBuffer::initialize();
+		if (arena)
+			PersistentBuffer::set_arena(1 << 20);
+		PersistentBuffer::set_alignment(4096);
+		for (uint32_t size : {1u, 100u, 5000u})
+		{
+			auto buffer = PersistentBuffer::single_buffer(size);
+			if (reinterpret_cast<uintptr_t>(buffer->rw()) % 4096)
+			{
+				std::cout << "alignment: " << size << " bytes from the " << (arena ? "arena" : "heap") << " are not 4KiB aligned" << std::endl;
+				ok = false;
+			}
+		}
+	}
+	PersistentBuffer::set_alignment(0);
+
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	PersistentBuffer::set_policy(PersistentBuffer::NumaAware);
+	auto first = PersistentBuffer::single_buffer(1000);
+	PersistentBuffer::release_buffer(first);
+	if (PersistentBuffer::single_buffer(1000).get() != first.get())
+	{
+		std::cout << "numa: a released buffer was not re-used" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+// a batch is matched against the free buffers in one pass, and comes back
+// in request order
+bool check_acquire_buffers()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+
+	std::vector<PersistentBuffer::BufferPtr> released{PersistentBuffer::single_buffer(100), PersistentBuffer::single_buffer(200), PersistentBuffer::single_buffer(300)};
+	PersistentBuffer::release_buffers(released);
+
+	std::vector<PersistentBuffer::BufferPtr> buffers;
+	PersistentBuffer::acquire_buffers({300, 100, 200, 350}, buffers);
+	bool ok{buffers.size() == 4};
+	for (size_t i = 0; ok && i < 3; ++i)
+		ok = (buffers[i].get() == released[(i + 2) % 3].get());
+	if (!ok || buffers[3]->size() != 350)
+	{
+		std::cout << "acquire_buffers: the batch was not matched in request order" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// a free buffer more oversized than the slack limit is left for a request
+// that needs it, and the in-use byte counts follow acquisition and release
+bool check_slack()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	PersistentBuffer::set_max_slack(25);
+	bool ok{true};
+
+	auto large = PersistentBuffer::single_buffer(1000);
+	PersistentBuffer::release_buffer(large);
+	auto before{PersistentBuffer::fragmentation_statistics()};
+	auto small = PersistentBuffer::single_buffer(100);
+	auto close = PersistentBuffer::single_buffer(900);
+	auto stats{PersistentBuffer::fragmentation_statistics()};
+	PersistentBuffer::set_max_slack(0);
+
+	if (small.get() == large.get() || close.get() != large.get() || stats.slack_misses != before.slack_misses + 1)
+	{
+		std::cout << "slack: an oversized buffer was re-used, or a close one was not" << std::endl;
+		ok = false;
+	}
+	if (stats.requested_bytes != 1000 || stats.allocated_bytes != 1100)
+	{
+		std::cout << "slack: " << stats.requested_bytes << " bytes requested and " << stats.allocated_bytes << " allocated, expected 1000 and 1100" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+// resizing keeps the live bytes and zeroes the ones gained, whether the
+// storage is replaced or a dedicated slab is remapped
+bool check_resize()
+{
+	bool ok{true};
+	for (bool arena : {false, true})
+	{
+		PersistentBuffer::reset();
+		PersistentBuffer::initialize();
+		if (arena)
+			PersistentBuffer::set_arena(1 << 20);
+		const uint32_t size{arena ? 800u * 1024 : 100u};
+
+		auto buffer = PersistentBuffer::single_buffer(size);
+		memset(buffer->rw(), 0x5a, size);
+		PersistentBuffer::resize_buffer(buffer, size / 2);
+		if (buffer->size() != size / 2)
+		{
+			std::cout << "resize: shrinking left the size at " << buffer->size() << std::endl;
+			ok = false;
+		}
+		PersistentBuffer::resize_buffer(buffer, size * 3);
+		if (buffer->size() != size * 3 || std::count(buffer->ro(), buffer->ro() + size / 2, 0x5a) != size / 2
+			|| std::count(buffer->ro() + size, buffer->ro() + size * 3, 0) != size * 2)
+		{
+			std::cout << "resize: growing " << (arena ? "a dedicated slab" : "a heap buffer") << " lost data or left bytes dirty" << std::endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+// a shrunk buffer must not hand the bytes it gave up to the next holder when
+// buffers are zeroed on release
+bool check_shrink_zeroing()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	PersistentBuffer::set_policy({PersistentBuffer::ZeroBuffer, PersistentBuffer::ZeroOnRelease});
+
+	auto buffer = PersistentBuffer::single_buffer(100);
+	memset(buffer->rw(), 0xAB, buffer->size());
+	PersistentBuffer::resize_buffer(buffer, 10);
+	auto* released = buffer.get();
+	PersistentBuffer::release_buffer(buffer);
+
+	buffer = PersistentBuffer::single_buffer(100);
+	bool ok{buffer.get() == released};
+	if (!ok)
+		std::cout << "shrink zeroing: the released buffer was not re-used" << std::endl;
+	for (uint32_t i = 0; ok && i < buffer->size(); ++i)
+	{
+		if (buffer->rw()[i])
+		{
+			std::cout << "shrink zeroing: stale byte at offset " << i << std::endl;
+			ok = false;
+		}
+	}
+	PersistentBuffer::release_buffer(buffer);
+	return ok;
+}
+
+// a snapshot counts each acquisition once, under its tier and size bucket
+bool check_snapshot_stats()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+
+	auto before{PersistentBuffer::snapshot_stats()};
+	PersistentBuffer::release_buffer(PersistentBuffer::single_buffer(100));
+	auto buffer = PersistentBuffer::single_buffer(100);
+	auto after{PersistentBuffer::snapshot_stats()};
+
+	if (after.misses != before.misses + 1 || after.global_hits != before.global_hits + 1
+		|| after.size_histogram[7] != before.size_histogram[7] + 2 || after.buffers_in_use != 1 || after.bytes_requested != 100)
+	{
+		std::cout << "statistics: a miss and a hit of 100 bytes were not counted as such" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// usage counted in a thread's cache survives the thread, balances against a
+// release on another thread, and is cleared by reset()
+bool check_thread_usage()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	PersistentBuffer::set_policy({PersistentBuffer::ZeroBuffer, PersistentBuffer::ThreadCache});
+	bool ok{true};
+
+	PersistentBuffer::BufferPtr kept;
+	std::thread([&kept] {
+		kept = PersistentBuffer::single_buffer(100);
+		PersistentBuffer::release_buffer(PersistentBuffer::single_buffer(200));
+	}).join();
+	auto stats{PersistentBuffer::snapshot_stats()};
+	if (PersistentBuffer::buffers_in_use() != 1 || stats.bytes_requested != 100 || stats.size_histogram[8] == 0)
+	{
+		std::cout << "usage counts: an exited thread's counts were lost" << std::endl;
+		ok = false;
+	}
+	PersistentBuffer::release_buffer(kept);
+	if (PersistentBuffer::buffers_in_use() != 0 || PersistentBuffer::fragmentation_statistics().requested_bytes != 0)
+	{
+		std::cout << "usage counts: a release on another thread did not balance" << std::endl;
+		ok = false;
+	}
+
+	kept = PersistentBuffer::single_buffer(100);
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	if (PersistentBuffer::buffers_in_use() != 0)
+	{
+		std::cout << "usage counts: reset() left " << PersistentBuffer::buffers_in_use() << " buffers in use" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+// the tracking report lists a buffer under the call site that acquired it
+// while 'Tracking' is set, follows it through a resize, and drops it once
+// released; 'UsageReport' writes the counts on every acquisition
+bool check_tracking()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+
+	// runs 'action' with stderr captured
+	auto capture = [](const std::function<void()>& action) {
+		std::ostringstream out;
+		auto previous{std::cerr.rdbuf(out.rdbuf())};
+		action();
+		std::cerr.rdbuf(previous);
+		return out.str();
+	};
+	auto report = [&capture] {
+		return capture(PersistentBuffer::report_tracking);
+	};
+
+	auto untracked = PersistentBuffer::single_buffer(100 PERSISTENTBUFFER_TRACKING_DATA);
+	const std::string untracked_site{std::string(__FILE__) + ":" + std::to_string(__LINE__ - 1)};
+	PersistentBuffer::set_policy({PersistentBuffer::ZeroBuffer, PersistentBuffer::Tracking});
+	auto buffer = PersistentBuffer::single_buffer(100 PERSISTENTBUFFER_TRACKING_DATA);
+	const std::string site{std::string(__FILE__) + ":" + std::to_string(__LINE__ - 1)};
+	PersistentBuffer::resize_buffer(buffer, 100000);
+	bool ok{true};
+	auto before{report()};
+	if (before.find(site) == std::string::npos || before.find(untracked_site) != std::string::npos)
+	{
+		std::cout << "tracking: the report does not name exactly the tracked call site" << std::endl;
+		ok = false;
+	}
+	PersistentBuffer::release_buffer(buffer);
+	if (report().find(site) != std::string::npos)
+	{
+		std::cout << "tracking: a released buffer is still reported" << std::endl;
+		ok = false;
+	}
+
+	PersistentBuffer::set_policy({PersistentBuffer::ZeroBuffer, PersistentBuffer::UsageReport});
+	if (capture([] { PersistentBuffer::single_buffer(100); }).find("buffers in use") == std::string::npos)
+	{
+		std::cout << "tracking: 'UsageReport' wrote nothing" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+// pools keep their buffers and counts to themselves, scoped buffers go back
+// to the pool they came from, and a pool's thread caches go with it
+bool check_pool_isolation()
+{
+	bool ok{true};
+	PersistentBuffer::BufferPtr outlived;
+	{
+		BufferPool a, b;
+		a.initialize();
+		b.initialize();
+		a.set_policy({BufferPool::ZeroBuffer, BufferPool::ThreadCache});
+		b.set_policy({BufferPool::ZeroBuffer, BufferPool::ThreadCache});
+
+		auto first = a.single_buffer(100);
+		a.release_buffer(first);
+		auto other = b.single_buffer(100);
+		if (other.get() == first.get() || a.buffers_in_use() != 0 || b.buffers_in_use() != 1)
+		{
+			std::cout << "pools: a buffer or its count crossed to another pool" << std::endl;
+			ok = false;
+		}
+		{
+			auto scoped = b.scoped_buffer(200);
+		}
+		if (b.buffers_in_use() != 1 || b.buffers_available() != 2 || a.buffers_available() != 1)
+		{
+			std::cout << "pools: a scoped buffer did not return to its own pool" << std::endl;
+			ok = false;
+		}
+		outlived = std::move(other);
+	}
+	if (outlived->size() != 0)
+	{
+		std::cout << "pools: a buffer outlived its pool without being made inert" << std::endl;
+		ok = false;
+	}
+
+	// a new pool, possibly at the same address, must not pick up the old caches
+	BufferPool c;
+	c.initialize();
+	c.set_policy({BufferPool::ZeroBuffer, BufferPool::ThreadCache});
+	c.release_buffer(c.single_buffer(100));
+	if (c.buffers_available() != 1 || c.buffers_in_use() != 0)
+	{
+		std::cout << "pools: a new pool inherited a destroyed pool's state" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+// reserved buffers serve the first requests without a miss, and a saved
+// profile reserves the same shape in another pool
+bool check_reserve()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	bool ok{true};
+
+	PersistentBuffer::reserve({{1000, 3}, {100, 2}});
+	auto misses{PersistentBuffer::snapshot_stats().misses};
+	std::vector<PersistentBuffer::BufferPtr> buffers;
+	PersistentBuffer::acquire_buffers({1000, 1000, 1000, 100, 100}, buffers);
+	if (PersistentBuffer::buffers_available() != 5 || PersistentBuffer::snapshot_stats().misses != misses)
+	{
+		std::cout << "reserve: reserved buffers did not serve the first requests" << std::endl;
+		ok = false;
+	}
+	PersistentBuffer::release_buffers(buffers);
+
+	const char* path{"check_reservation_profile.txt"};
+	BufferPool other;
+	other.initialize();
+	if (!PersistentBuffer::save_reservation_profile(path) || !other.load_reservation_profile(path)
+		|| other.reservation_profile().size() != 2 || other.buffers_available() != 5)
+	{
+		std::cout << "reserve: a saved profile did not reserve the same buffers" << std::endl;
+		ok = false;
+	}
+	std::remove(path);
+	return ok;
+}
+
+// a chain describes its segments for vectored I/O and releases them all,
+// including appended ones, when it goes
+bool check_buffer_chain()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	bool ok{true};
+	{
+		auto chain{PersistentBuffer::acquire_chain({100, 200})};
+		chain.append(PersistentBuffer::single_buffer(50));
+		if (chain.segments() != 3 || chain.bytes() != 350)
+		{
+			std::cout << "chain: " << chain.segments() << " segments of " << chain.bytes() << " bytes, expected 3 of 350" << std::endl;
+			ok = false;
+		}
+#ifndef _WIN32
+		if (chain.iovcnt() != 3 || chain.iov()[2].iov_base != chain.segment(2)->rw() || chain.iov()[1].iov_len != 200)
+		{
+			std::cout << "chain: the iovec array does not match the segments" << std::endl;
+			ok = false;
+		}
+#endif
+		auto moved{std::move(chain)};
+		if (!chain.empty() || moved.segments() != 3)
+		{
+			std::cout << "chain: a move did not hand over the segments" << std::endl;
+			ok = false;
+		}
+	}
+	if (PersistentBuffer::buffers_in_use() != 0)
+	{
+		std::cout << "chain: " << PersistentBuffer::buffers_in_use() << " segments were not released" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+// slices are clipped views that keep their buffer checked out until the
+// last of them is dropped
+bool check_slices()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	bool ok{true};
+
+	PersistentBuffer::BufferSlice tail;
+	{
+		PersistentBuffer::BufferSlice whole{PersistentBuffer::BufferHandle(PersistentBuffer::single_buffer(100))};
+		whole.rw()[60] = 7;
+		tail = whole.slice(50, 50).slice(10, 20);
+		if (tail.size() != 20 || tail.offset() != 60 || tail.ro()[0] != 7)
+		{
+			std::cout << "slices: a slice of a slice does not view the right bytes" << std::endl;
+			ok = false;
+		}
+	}
+	if (PersistentBuffer::buffers_in_use() != 1)
+	{
+		std::cout << "slices: the buffer was released while a slice still held it" << std::endl;
+		ok = false;
+	}
+	tail.reset();
+	if (PersistentBuffer::buffers_in_use() != 0)
+	{
+		std::cout << "slices: dropping the last slice did not release the buffer" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+// a pool that maps the file again gets the released buffers back with their
+// contents, at the offsets another reader of the file would find them
+bool check_map_arena()
+{
+#ifdef _WIN32
+	return true;
+#else
+	const char* path{"check_arena.pool"};
+	std::remove(path);
+	bool ok{true};
+	int64_t offset{-1};
+	{
+		BufferPool first;
+		first.initialize();
+		if (!first.map_arena(path, 4 * 1024 * 1024))
+		{
+			std::cout << "map_arena: the file could not be mapped" << std::endl;
+			return false;
+		}
+		auto buffer = first.single_buffer(1000);
+		memcpy(buffer->rw(), "persisted", 10);
+		offset = first.mapped_offset(buffer);
+		first.release_buffer(buffer);
+	}
+
+	BufferPool second;
+	second.initialize();
+	second.clear_policy(BufferPool::ZeroBuffer);
+	if (!second.map_arena(path) || second.buffers_available() != 1)
+	{
+		std::cout << "map_arena: the released buffer was not restored" << std::endl;
+		ok = false;
+	}
+	else
+	{
+		auto buffer = second.single_buffer(1000);
+		std::ifstream file(path, std::ios::binary);
+		char stored[10]{};
+		file.seekg(offset);
+		file.read(stored, sizeof(stored));
+		if (offset < 0 || second.mapped_offset(buffer) != offset || memcmp(buffer->ro(), "persisted", 10) || memcmp(stored, "persisted", 10))
+		{
+			std::cout << "map_arena: the restored buffer lost its contents or moved" << std::endl;
+			ok = false;
+		}
+	}
+	std::remove(path);
+	return ok;
+#endif
+}
+
+// a compile-time size is served from its size class, and a new layout is
+// not served from the class remembered from the old one
+bool check_sized_acquire()
+{
+	bool ok{true};
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize(PersistentBuffer::BinLayout::PowerOfTwo);
+	for (int layout = 0; layout < 2; ++layout)
+	{
+		auto buffer = PersistentBuffer::single_buffer<100>();
+		auto* first = buffer.get();
+		PersistentBuffer::release_buffer(buffer);
+		// 120 bytes share the 128-byte class; with {64, 256}, 200 bytes share the 256-byte one
+		buffer = PersistentBuffer::single_buffer(layout ? 200 : 120);
+		if (buffer.get() != first)
+		{
+			std::cout << "sized acquire: single_buffer<100>() missed its class in layout " << layout << std::endl;
+			ok = false;
+		}
+		PersistentBuffer::release_buffer(buffer);
+
+		PersistentBuffer::reset();
+		PersistentBuffer::initialize(std::vector<uint32_t>{64, 256});
+	}
+
+	const uint8_t data[100]{1, 2, 3};
+	auto copy = PersistentBuffer::single_buffer_from<100>(data);
+	if (copy->size() != 100 || memcmp(copy->ro(), data, 100))
+	{
+		std::cout << "sized acquire: single_buffer_from<100>() did not copy its content" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+// single_buffer<N>() remembers its size class separately for each pool
+bool check_sized_pools()
+{
+	bool ok{true};
+	BufferPool a, b;
+	a.initialize(BufferPool::BinLayout::PowerOfTwo);
+	b.initialize(std::vector<uint32_t>{64, 256});
+	for (int round = 0; round < 2; ++round)
+	{
+		auto x = a.single_buffer<100>();
+		auto y = b.single_buffer<100>();
+		if (x->size() != 100 || y->size() != 100 || a.size_class(100) != 128 || b.size_class(100) != 256)
+		{
+			std::cout << "sized pools: single_buffer<100>() was served from the wrong class" << std::endl;
+			ok = false;
+		}
+		auto* first = y.get();
+		a.release_buffer(x);
+		b.release_buffer(y);
+		// 200 bytes share the 256-byte class in 'b' only
+		y = b.single_buffer(200);
+		if (y.get() != first)
+		{
+			std::cout << "sized pools: the other pool's class was used in round " << round << std::endl;
+			ok = false;
+		}
+		b.release_buffer(y);
+	}
+	return ok;
+}
+
+// a pool at its capacity refuses, waits or queues, and a release makes room
+bool check_capacity()
+{
+	bool ok{true};
+	BufferPool pool;
+	pool.initialize(BufferPool::BinLayout::PowerOfTwo);
+	pool.set_capacity(0, 1);
+
+	auto held = pool.single_buffer(100);
+	bool threw{false};
+	try
+	{
+		pool.single_buffer(100);
+	}
+	catch (const std::bad_alloc&)
+	{
+		threw = true;
+	}
+	if (pool.try_single_buffer(100) || !threw)
+	{
+		std::cout << "capacity: a full size class handed out a second buffer" << std::endl;
+		ok = false;
+	}
+
+	auto waiter = std::async(std::launch::async, [&pool] {
+		return pool.single_buffer_wait(100, std::chrono::seconds(10));
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	pool.release_buffer(held);
+	held = waiter.get();
+	if (!held)
+	{
+		std::cout << "capacity: a release did not wake single_buffer_wait()" << std::endl;
+		ok = false;
+	}
+
+	BufferPool::BufferPtr delivered;
+	pool.single_buffer_async(100, [&delivered](BufferPool::BufferPtr buffer) { delivered = std::move(buffer); });
+	if (delivered)
+	{
+		std::cout << "capacity: a queued request was served while the class was full" << std::endl;
+		ok = false;
+	}
+	pool.release_buffer(held);
+	if (!delivered)
+	{
+		std::cout << "capacity: a release did not serve the queued request" << std::endl;
+		ok = false;
+	}
+	pool.release_buffer(delivered);
+	return ok;
+}
+
+// growing a buffer in its own slab must respect the pool's capacity limit
+bool check_remap_capacity()
+{
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize(PersistentBuffer::BinLayout::None);
+	PersistentBuffer::set_arena(1 << 20);
+	PersistentBuffer::set_capacity(1 << 20);
+
+	auto buffer = PersistentBuffer::single_buffer(600 * 1024);
+	bool ok{true};
+	if (PersistentBuffer::resize_buffer(buffer, 8 << 20))
+	{
+		std::cout << "remap capacity: grew past the capacity limit" << std::endl;
+		ok = false;
+	}
+	auto allocated = PersistentBuffer::snapshot_stats().bytes_allocated;
+	if (allocated > (1 << 20))
+	{
+		std::cout << "remap capacity: " << allocated << " bytes allocated" << std::endl;
+		ok = false;
+	}
+	PersistentBuffer::release_buffer(buffer);
+	PersistentBuffer::set_capacity();
+	return ok;
+}
+
+// a buffer that resize_buffer() moves out of a full class serves what waits on it
+bool check_resize_capacity()
+{
+	bool ok{true};
+	BufferPool pool;
+	pool.initialize(BufferPool::BinLayout::PowerOfTwo);
+	pool.set_capacity(0, 1);
+
+	auto held = pool.single_buffer(100);
+	BufferPool::BufferPtr delivered;
+	pool.single_buffer_async(100, [&delivered](BufferPool::BufferPtr buffer) { delivered = std::move(buffer); });
+	if (!pool.resize_buffer(held, 1000) || !delivered)
+	{
+		std::cout << "resize capacity: the buffer given up did not serve the queued request" << std::endl;
+		ok = false;
+	}
+	pool.release_buffer(held);
+	if (delivered)
+		pool.release_buffer(delivered);
+	return ok;
+}
+
+// warm starts count against the capacity limits, and are refused whole
+bool check_warm_start_capacity()
+{
+	bool ok{true};
+	BufferPool pool;
+	pool.initialize(BufferPool::BinLayout::PowerOfTwo);
+	pool.set_capacity(4096, 2);
+	if (pool.reserve({{1000, 8}}) || pool.reserve({{100, 3}}) || pool.buffers_available() != 0)
+	{
+		std::cout << "warm start: a reservation over the capacity was taken" << std::endl;
+		ok = false;
+	}
+	if (!pool.reserve({{1000, 2}, {100, 2}}) || pool.buffers_available() != 4)
+	{
+		std::cout << "warm start: a reservation within the capacity was refused" << std::endl;
+		ok = false;
+	}
+
+#ifndef _WIN32
+	const char* path{"check_capacity.pool"};
+	std::remove(path);
+	{
+		BufferPool first;
+		first.initialize();
+		first.map_arena(path, 4 * 1024 * 1024);
+		first.release_buffers({first.single_buffer(1000), first.single_buffer(2000)});
+	}
+	BufferPool limited;
+	limited.initialize();
+	limited.set_capacity(2500);
+	if (limited.map_arena(path) || limited.buffers_available() != 0)
+	{
+		std::cout << "warm start: map_arena() restored more than the capacity" << std::endl;
+		ok = false;
+	}
+	limited.set_capacity();
+	if (!limited.map_arena(path) || limited.buffers_available() != 2)
+	{
+		std::cout << "warm start: map_arena() did not restore within the capacity" << std::endl;
+		ok = false;
+	}
+	std::remove(path);
+#endif
+	return ok;
+}
+
+// with 'SoftRelease', an expired buffer is made cold instead of dropped, and
+// stays where it can be re-used
+bool check_soft_release()
+{
+	bool ok{true};
+	BufferPool pool;
+	pool.initialize();
+	pool.set_policy(BufferPool::SoftRelease);
+	pool.set_cleanup_timeout(1);
+
+	auto idle = pool.single_buffer(64 * 1024);
+	auto* storage = idle.get();
+	pool.release_buffer(idle);
+	std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+	// too large to be served by the idle buffer, so this takes the miss path
+	auto miss = pool.single_buffer(128 * 1024);
+
+	auto stats = pool.snapshot_stats();
+	if (stats.gc_cold_buffers != 1 || stats.gc_cold_bytes < 60 * 1024 || pool.buffers_available() != 2)
+	{
+		std::cout << "soft release: " << stats.gc_cold_buffers << " buffers made cold, "
+				  << pool.buffers_available() << " buffers held" << std::endl;
+		ok = false;
+	}
+	auto reused = pool.single_buffer(64 * 1024);
+	if (reused.get() != storage || reused->ro()[0] != 0)
+	{
+		std::cout << "soft release: the cold buffer was not re-used, zeroed" << std::endl;
+		ok = false;
+	}
+	pool.release_buffers({miss, reused});
+	return ok;
+}
+
+// the benchmark's handoff ring keeps order and refuses when full, and a
+// producer/consumer run hands every buffer back to the pool
+bool check_bench_handoff()
+{
+	bool ok{true};
+	HandoffRing<int> ring(2);
+	int a{1}, b{2}, c{3}, out{0};
+	if (!ring.push(a) || !ring.push(b) || ring.push(c) || !ring.pop(out) || out != 1 || !ring.pop(out) || out != 2 || ring.pop(out))
+	{
+		std::cout << "bench: the handoff ring lost its order or its bound" << std::endl;
+		ok = false;
+	}
+
+	PoolAllocator allocator(BufferPool::BinLayout::PowerOfTwo, false);
+	auto result = run_producer_consumer_bench(allocator, distribution_sizes(SizeDistribution::FixedSet, 64), 2, 1000);
+	if (allocator.pool.buffers_in_use() != 0 || result.mops <= 0.0)
+	{
+		std::cout << "bench: " << allocator.pool.buffers_in_use() << " buffers still in use after a producer/consumer run" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+// with 'ThreadCache', a buffer released on another thread goes back to the
+// cache of the thread that acquired it
+bool check_remote_release()
+{
+	bool ok{true};
+	BufferPool pool;
+	pool.initialize(BufferPool::BinLayout::PowerOfTwo);
+	pool.set_policy({BufferPool::ZeroBuffer, BufferPool::ThreadCache});
+
+	auto buffer = pool.single_buffer(1000);
+	auto* storage = buffer.get();
+	std::thread([&pool, &buffer] { pool.release_buffer(buffer); }).join();
+	buffer.reset();
+
+	auto reused = pool.single_buffer(1000);
+	auto stats = pool.cache_statistics();
+	if (reused.get() != storage || stats.remote_releases != 1 || stats.remote_drains != 1)
+	{
+		std::cout << "remote release: " << stats.remote_releases << " releases handed back, "
+				  << stats.remote_drains << " drains" << std::endl;
+		ok = false;
+	}
+	pool.release_buffer(reused);
+	return ok;
+}
+
+// a buffer handed back to a thread as it exits still reaches the shared pool
+bool check_remote_release_exit()
+{
+	BufferPool pool;
+	pool.initialize(BufferPool::BinLayout::PowerOfTwo);
+	pool.set_policy(BufferPool::ThreadCache);
+
+	for (int round = 0; round < 200; ++round)
+	{
+		// the owner exits as soon as it has handed its buffers over, while
+		// they are being released
+		std::vector<BufferPool::BufferPtr> buffers;
+		std::promise<void> acquired;
+		auto handed_over = acquired.get_future();
+		std::thread owner([&pool, &buffers, &acquired] {
+			for (int i = 0; i < 16; ++i)
+				buffers.push_back(pool.single_buffer(100 + i * 100));
+			acquired.set_value();
+		});
+		std::thread releaser([&pool, &buffers, &handed_over] {
+			handed_over.wait();
+			for (auto& buffer : buffers)
+				pool.release_buffer(buffer);
+		});
+		owner.join();
+		releaser.join();
+	}
+
+	// with every thread gone, all the buffers are free in the shared pool,
+	// where a lowered capacity drops them
+	pool.set_capacity(1);
+	auto stats = pool.snapshot_stats();
+	if (stats.buffers_allocated != 0)
+	{
+		std::cout << "remote release: " << stats.buffers_allocated << " buffers stranded by exiting threads" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// with 'AdaptiveSizing', misses on a popular size are rounded up to the top
+// of its step, including when the requests were counted by thread caches
+bool check_adaptive_sizing()
+{
+	bool ok{true};
+	for (bool cached : {false, true})
+	{
+		BufferPool pool;
+		pool.initialize();
+		pool.set_policy(BufferPool::AdaptiveSizing);
+		if (cached)
+			pool.set_policy(BufferPool::ThreadCache);
+
+		std::vector<BufferPool::BufferPtr> held;
+		for (int i = 0; i < 8; ++i)
+			held.push_back(pool.single_buffer(1000));
+		// thread caches' counts reach the pool at most once a second, and may
+		// be halved twice by then
+		if (cached)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+		auto before = pool.snapshot_stats().bytes_allocated;
+		auto rounded = pool.single_buffer(1000);
+		auto allocated = pool.snapshot_stats().bytes_allocated - before;
+		if (allocated != 1024)
+		{
+			std::cout << "adaptive sizing: " << allocated << " bytes allocated for a popular 1000"
+					  << (cached ? ", with thread caches" : "") << std::endl;
+			ok = false;
+		}
+		held.push_back(rounded);
+		pool.release_buffers(held);
+	}
+	return ok;
+}
+
+// a trace hook sees every acquisition, release and miss, on the thread-cache
+// tier as well, and nothing once it is removed
+bool check_trace_hook()
+{
+	bool ok{true};
+	BufferPool pool;
+	pool.initialize();
+	pool.set_policy({BufferPool::ThreadCache, BufferPool::LockProfiling});
+
+	std::array<int, 7> events{};
+	pool.set_trace_hook([](const BufferPool::TraceRecord& record, void* context) {
+		++(*static_cast<std::array<int, 7>*>(context))[static_cast<int>(record.event)];
+	}, &events);
+	for (int i = 0; i < 2; ++i)
+	{
+		auto buffer = pool.single_buffer(100);
+		pool.release_buffer(buffer);
+	}
+	pool.set_trace_hook(nullptr);
+	pool.release_buffer(pool.single_buffer(100));
+
+	using Event = BufferPool::TraceEvent;
+	if (events[static_cast<int>(Event::Acquire)] != 2 || events[static_cast<int>(Event::Release)] != 2 ||
+		events[static_cast<int>(Event::Miss)] != 1 || events[static_cast<int>(Event::LockHold)] == 0)
+	{
+		std::cout << "trace hook: " << events[static_cast<int>(Event::Acquire)] << " acquisitions, "
+				  << events[static_cast<int>(Event::Release)] << " releases and "
+				  << events[static_cast<int>(Event::Miss)] << " misses traced" << std::endl;
+		ok = false;
+	}
+	if (pool.snapshot_stats().lock_hold_ns == 0)
+	{
+		std::cout << "trace hook: 'LockProfiling' timed no lock holds" << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+
+int run_checks()
+{
+	int failures{0};
+	failures += !check_thread_cache();
+	failures += !check_batch_release_without_cache();
+	failures += !check_size_classes();
+	failures += !check_size_index();
+	failures += !check_fixed_pool();
+	failures += !check_arena();
+	failures += !check_handles();
+	failures += !check_registry();
+	failures += !check_age_gc();
+	failures += !check_reclaimer();
+	failures += !check_coarse_clock();
+	failures += !check_zero_reuse();
+	failures += !check_alignment_numa();
+	failures += !check_acquire_buffers();
+	failures += !check_slack();
+	failures += !check_resize();
+	failures += !check_shrink_zeroing();
+	failures += !check_snapshot_stats();
+	failures += !check_thread_usage();
+	failures += !check_tracking();
+	failures += !check_pool_isolation();
+	failures += !check_reserve();
+	failures += !check_buffer_chain();
+	failures += !check_slices();
+	failures += !check_map_arena();
+	failures += !check_sized_acquire();
+	failures += !check_sized_pools();
+	failures += !check_capacity();
+	failures += !check_remap_capacity();
+	failures += !check_resize_capacity();
+	failures += !check_warm_start_capacity();
+	failures += !check_soft_release();
+	failures += !check_bench_handoff();
+	failures += !check_remote_release();
+	failures += !check_remote_release_exit();
+	failures += !check_adaptive_sizing();
+	failures += !check_trace_hook();
+
+	PersistentBuffer::reset();
+	PersistentBuffer::initialize();
+	std::cout << (failures ? "checks failed" : "checks passed") << std::endl;
+	return failures ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+	PersistentBuffer::initialize();
+
+	// "check" runs only the correctness checks, and fails if any do
+	if (argc > 1 && std::string(argv[1]) == "check")
+		return run_checks();
+
+	// "miss" runs only the miss-path/reuse-path latency benchmark
+	if (argc > 1 && std::string(argv[1]) == "miss")
+	{
+		report_miss_path_test();
+		return 0;
+	}
+
+	// "zero" runs only the 'ZeroBuffer' cost benchmark
+	if (argc > 1 && std::string(argv[1]) == "zero")
+	{
+		report_zero_test();
+		return 0;
+	}
+
+	// "bench [threads] [operations]" runs only the multi-threaded benchmark
+	// suite, against the heap baselines
+	if (argc > 1 && std::string(argv[1]) == "bench")
+	{
+		int threads = argc > 2 ? std::atoi(argv[2]) : static_cast<int>(std::thread::hardware_concurrency());
+		int ops = argc > 3 ? std::atoi(argv[3]) : 200000;
+		report_bench(std::max(threads, 1), std::max(ops, 2));
+		return 0;
+	}
+
+	// the throughput tests measure the pool itself; the cost of zeroing is
+	// measured separately, by the "zero" run
+	PersistentBuffer::clear_policy(PersistentBuffer::ZeroBuffer);
+
+	// set an upper size for any given buffer size requirement
+	auto max = 500000;
+
+	// number of iterations
+	auto iter = 1000000;
+
+	// test the speed of the single_buffer() method that will allocate (or reuse)
+	// a single buffer
+	auto millis = run_single_buffer_test(max, iter);
+	std::cout << "     single_buffer(): " << millis << " ms" << std::endl;
+
+	// test the speed of the single_buffer_from() method that will allocate (or reuse)
+	// a buffer and the populated with the provided data
+	millis = run_single_buffer_from_test(iter);
+	std::cout << "single_buffer_from(): " << millis << " ms" << std::endl;
+
+	// test the speed of just the release_buffers() method where multiple buffers are
+	// returned at the same time
+	millis = run_release_buffers_test(max, iter);
+	std::cout << "   release_buffers(): " << millis << " ms" << std::endl;
+
+	// test the speed of just the acquire_buffers() method where multiple buffers are
+	// retrieved at the same time
+	millis = run_acquire_buffers_test(max, iter);
+	std::cout << "   acquire_buffers(): " << millis << " ms" << std::endl;
+
+	std::cout << std::endl
+			  << PersistentBuffer::buffers_available() << " buffers were allocated out of "
+			  << (iter /*run_single_buffer_test()*/ + iter /*run_single_buffer_from_test*/ +
+				  (iter * max_buffers.size()) /**run_release_buffers_test*/ +
+				  (iter * max_buffers.size()) /**run_acquire_buffers_test*/)
+			  << " buffer requests." << std::endl;
+
+	// test the latency of acquisitions that miss the pool against those that
+	// re-use a pooled buffer
+	std::cout << std::endl;
+	report_miss_path_test();
 }